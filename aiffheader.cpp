@@ -0,0 +1,207 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)MIT
+ *
+ * Flacon - audio File Encoder
+ * https://github.com/flacon/flacon
+ *
+ * Copyright: 2022
+ *   Alexander Sokoloff <sokoloff.a@gmail.com>
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Alexander Sokoloff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#include "aiffheader.h"
+#include <cmath>
+#include <cstring>
+#include <string>
+
+static const char *AIFF_FORM = "FORM";
+static const char *AIFF_AIFF = "AIFF";
+static const char *AIFF_AIFC = "AIFC";
+static const char *AIFF_COMM = "COMM";
+static const char *AIFF_SSND = "SSND";
+
+/************************************************
+ *
+ ************************************************/
+static void mustRead(std::istream *stream, char *data, size_t size)
+{
+    if (!stream->read(data, size)) {
+        throw WavHeaderError("Unexpected end of file on " + std::to_string(stream->tellg()));
+    }
+}
+
+/************************************************
+ *
+ ************************************************/
+static uint32_t readUInt32(std::istream *stream)
+{
+    uint8_t b[4];
+    mustRead(stream, (char *)b, 4);
+    return (uint32_t(b[0]) << 24) | (uint32_t(b[1]) << 16) | (uint32_t(b[2]) << 8) | uint32_t(b[3]);
+}
+
+/************************************************
+ *
+ ************************************************/
+static uint16_t readUInt16(std::istream *stream)
+{
+    uint8_t b[2];
+    mustRead(stream, (char *)b, 2);
+    return uint16_t((b[0] << 8) | b[1]);
+}
+
+/************************************************
+ * 80-bit IEEE 754 extended precision number: the sign,
+ * a 15-bit exponent and a 64-bit mantissa with an explicit
+ * integer bit
+ ************************************************/
+static double readExtended(std::istream *stream)
+{
+    uint8_t b[10];
+    mustRead(stream, (char *)b, 10);
+
+    int      exponent = ((b[0] & 0x7F) << 8) | b[1];
+    uint64_t mantissa = 0;
+    for (int i = 2; i < 10; ++i) {
+        mantissa = (mantissa << 8) | b[i];
+    }
+
+    double res = std::ldexp(double(mantissa), exponent - 16383 - 63);
+    return (b[0] & 0x80) ? -res : res;
+}
+
+/************************************************
+ * 46 4F 52 4D      FORM
+ * 00 01 2A 5E      file size - 8
+ * 41 49 46 46      AIFF or AIFC
+ *
+ * // Chunks, padded to an even size
+ *   43 4F 4D 4D    "COMM"
+ *   00 00 00 12    chunk size, 18 in AIFF
+ *         00 02      NumChannels        2
+ *   00 00 4A B9      NumSampleFrames
+ *         00 10      SampleSize        16
+ *   40 0E AC 44 ..   SampleRate     44100 (80-bit)
+ *   .. .. .. ..      CompressionType and name, AIFF-C only
+ * // Data
+ *   53 53 4E 44    "SSND"
+ *   00 01 2A 2E    chunk size
+ *   00 00 00 00      Offset to the first sample
+ *   00 00 00 00      BlockSize
+ ************************************************/
+AiffHeader::AiffHeader(std::istream *stream) noexcept(false)
+{
+    char tag[4];
+    mustRead(stream, tag, 4);
+    if (strncmp(tag, AIFF_FORM, 4) != 0) {
+        throw WavHeaderError("AIFF header is missing FORM tag while processing file");
+    }
+
+    // a program writing to a pipe can't go back to set the sizes, it leaves them 0
+    uint32_t formSize = readUInt32(stream);
+    mFileSize         = (formSize == 0 || formSize == 0xFFFFFFFF) ? UINT64_MAX : uint64_t(formSize) + 8;
+
+    mustRead(stream, tag, 4);
+    bool aifc = strncmp(tag, AIFF_AIFC, 4) == 0;
+    if (!aifc && strncmp(tag, AIFF_AIFF, 4) != 0) {
+        throw WavHeaderError("AIFF header is missing AIFF tag while processing file");
+    }
+
+    bool     hasComm   = false;
+    uint32_t numFrames = 0;
+    uint64_t pos       = 12;
+    while (pos < mFileSize) {
+        char chunkId[4];
+        mustRead(stream, chunkId, 4);
+        uint32_t chunkSize = readUInt32(stream);
+        uint32_t padding   = chunkSize & 1;
+        pos += 8;
+
+        if (strncmp(chunkId, AIFF_COMM, 4) == 0) {
+            if (chunkSize < (aifc ? 22 : 18)) {
+                throw WavHeaderError("[AIFF] incorrect COMM chunk size " + std::to_string(chunkSize));
+            }
+
+            mNumChannels   = readUInt16(stream);
+            numFrames      = readUInt32(stream);
+            mBitsPerSample = readUInt16(stream);
+
+            double   rate = readExtended(stream);
+            uint32_t done = 18;
+
+            mBigEndian = true;
+            if (aifc) {
+                char compression[4];
+                mustRead(stream, compression, 4);
+                done += 4;
+
+                if (strncmp(compression, "sowt", 4) == 0) {
+                    mBigEndian = false;
+                }
+                else if (strncmp(compression, "NONE", 4) != 0 && strncmp(compression, "twos", 4) != 0) {
+                    throw WavHeaderError("[AIFF-C] unsupported compression type " + std::string(compression, 4));
+                }
+            }
+            skip(stream, chunkSize - done + padding);
+
+            // unlike the WAV ones, the 8-bit AIFF samples are signed
+            if (mBitsPerSample <= 8) {
+                throw WavHeaderError("[AIFF] 8-bit samples are not supported");
+            }
+
+            if (!(rate >= 1 && rate <= UINT32_MAX)) {
+                throw WavHeaderError("[AIFF] incorrect sample rate " + std::to_string(rate));
+            }
+
+            mFormat     = Format_PCM;
+            mSampleRate = uint32_t(std::lround(rate));
+            mBlockAlign = (mBitsPerSample + 7) / 8 * mNumChannels;
+            mByteRate   = mBlockAlign * mSampleRate;
+            hasComm     = true;
+            pos += chunkSize + padding;
+            continue;
+        }
+
+        if (strncmp(chunkId, AIFF_SSND, 4) == 0) {
+            if (!hasComm) {
+                throw WavHeaderError("[AIFF] the SSND chunk comes before the COMM chunk");
+            }
+
+            uint32_t offset = readUInt32(stream);
+            readUInt32(stream); // BlockSize, not used
+            skip(stream, offset);
+
+            // the number of frames of a pipe is 0, only the caller knows if the input is one
+            mDataStartPos = pos + 8 + offset;
+            mDataSize     = uint64_t(numFrames) * mBlockAlign;
+            return;
+        }
+
+        skip(stream, chunkSize + padding);
+        pos += chunkSize + padding;
+    }
+
+    throw WavHeaderError("SSND chunk not found");
+}
@@ -106,10 +106,29 @@ bool Atom::TypeId::isEmpty() const
     return true;
 }
 
+/************************************************
+ * The header of an mdat atom
+ * A size of 1 means that the 64-bit size follows the type.
+ ************************************************/
+Bytes mdatHeader(uint64_t dataSize)
+{
+    Bytes res;
+    if (dataSize + 8 > UINT32_MAX) {
+        res << uint32_t(1);
+        res << "mdat";
+        res << uint64_t(dataSize + 16);
+    }
+    else {
+        res << uint32_t(dataSize + 8);
+        res << "mdat";
+    }
+    return res;
+}
+
 /************************************************
  * Atom_ftyp
  ************************************************/
-FtypAtom::FtypAtom()
+FtypAtom::FtypAtom(bool fragmented)
 {
     typeId = "ftyp";
 
@@ -120,6 +139,11 @@ FtypAtom::FtypAtom()
     data << "M4A ";
     data << "isom";
     data << "iso2";
+
+    // the tfdt atom and the data offsets from the moof atom
+    if (fragmented) {
+        data << "iso5";
+    }
 }
 
 /************************************************
@@ -130,6 +154,9 @@ MoovAtom::MoovAtom(const Encoder &encoder)
     typeId = "moov";
     subAtoms.push_back(MvhdAtom(encoder));
     subAtoms.push_back(TrakAtom(encoder));
+    if (encoder.fragmented()) {
+        subAtoms.push_back(MvexAtom(encoder));
+    }
     subAtoms.push_back(UdtaAtom(encoder));
 }
 
@@ -166,7 +193,7 @@ MvhdAtom::MvhdAtom(const Encoder &encoder)
     // Duration
     // A time value that indicates the duration of the movie in time scale units. Note that this property is derived from the movie’s tracks.
     // The value of this field corresponds to the duration of the longest track in the movie.
-    data << uint32_t(std::ceil(encoder.inputWavHeader().dataSize() * 1000.0 / encoder.inputWavHeader().byteRate()));
+    data << uint32_t(encoder.fragmented() ? 0 : std::ceil(encoder.inputWavHeader().dataSize() * 1000.0 / encoder.inputWavHeader().byteRate()));
 
     // Preferred rate
     // A 32-bit fixed-point number that specifies the rate at which to play this movie. A value of 1.0 indicates normal rate.
@@ -264,7 +291,7 @@ TkhdAtom::TkhdAtom(const Encoder &encoder)
 
     // Duration
     // A time value that indicates the duration of this track (in the movie’s time coordinate system). Note that this property is derived from the track’s edits. The value of this field is equal to the sum of the durations of all of the track’s edits. If there is no edit list, then the duration is the sum of the sample durations, converted into the movie timescale.
-    data << uint32_t(encoder.inputWavHeader().duration());
+    data << uint32_t(encoder.fragmented() ? 0 : encoder.inputWavHeader().duration());
 
     // Reserved
     // An 8-byte value that is reserved for use by Apple. Set this field to 0.
@@ -343,7 +370,7 @@ MdhdAtom::MdhdAtom(const Encoder &encoder)
 
     // Duration
     // The duration of this media in units of its time scale.
-    data << uint32_t(encoder.inputWavHeader().duration() / encoder.inputWavHeader().sampleRate() / 1000.0);
+    data << uint32_t(encoder.fragmented() ? 0 : encoder.inputWavHeader().duration() / encoder.inputWavHeader().sampleRate() / 1000.0);
 
     // Language
     // A 16-bit integer that specifies the language code for this media. See Language Code Values for valid language codes.
@@ -619,7 +646,7 @@ StsdAtom::StsdAtom(const Encoder &encoder)
 
     // Sample size (bits)
     // A 16-bit integer that specifies the number of bits in each uncompressed sound sample. Allowable values are 8 or 16. Formats using more than 16 bits per sample set this field to 16 and use sound description version 1.
-    data << uint16_t(encoder.inputWavHeader().bitsPerSample());
+    data << uint16_t(encoder.bitDepth());
 
     // Compression ID
     // A 16-bit integer that must be set to 0 for version 0 sound descriptions. This may be set to –2 for some version 1 sound descriptions; see Redefined Sample Tables.
@@ -678,7 +705,9 @@ StscAtom::StscAtom(const Encoder &encoder)
 
     // Number of entries
     // A 32-bit integer containing the number of sample descriptions that follow.
-    data << uint32_t(1);
+    // The fragmented files have no samples in the moov atom, so no chunks
+    const uint32_t numChunks = encoder.fragmented() ? 0 : 1;
+    data << uint32_t(numChunks);
 
     // Sample-to-chunk table
     // * 32bit - First chunk
@@ -688,16 +717,20 @@ StscAtom::StscAtom(const Encoder &encoder)
     // I have not found the logic by which samples are combined into chunks,
     // so I use one chunk for all samples.
     // If you have more information, tell me.
-    data << uint32_t(1);
-    data << uint32_t(encoder.sampleSizeTable().size());
-    data << uint32_t(1);
+    if (numChunks > 0) {
+        data << uint32_t(1);
+        data << uint32_t(encoder.sampleSizeTable().size());
+        data << uint32_t(1);
+    }
 }
 
 /// Chunk Offset Atoms
 /// Chunk offset atoms identify the location of each chunk of data in the media’s data stream.
+/// The co64 atom has 64-bit offsets, for the data that starts 4 GiB or more into the file.
 StcoAtom::StcoAtom(const Encoder &encoder)
 {
-    typeId = "stco";
+    const bool is64Bit = encoder.audioDataStartPos() > UINT32_MAX;
+    typeId             = is64Bit ? "co64" : "stco";
 
     // Version
     // A 1-byte specification of the version of this sample description atom.
@@ -708,13 +741,19 @@ StcoAtom::StcoAtom(const Encoder &encoder)
     data << '\0' << '\0' << '\0';
 
     // Number of entries
-    data << uint32_t(1);
+    const uint32_t numChunks = encoder.fragmented() ? 0 : 1;
+    data << uint32_t(numChunks);
 
     // Chunk offset table
     // A chunk offset table consisting of an array of offset values.
     // There is one table entry for each chunk in the media.
     // Offsets are file offsets, not the offset into any atom.
-    data << uint32_t(encoder.audioDataStartPos());
+    if (numChunks > 0 && is64Bit) {
+        data << uint64_t(encoder.audioDataStartPos());
+    }
+    else if (numChunks > 0) {
+        data << uint32_t(encoder.audioDataStartPos());
+    }
 }
 
 /// Sample Size Atom
@@ -760,30 +799,26 @@ SttsAtom::SttsAtom(const Encoder &encoder)
     // A 3-byte space for sample description flags. Set this field to 0.
     data << '\0' << '\0' << '\0';
 
-    // uint32_t total = encoder.inputWavHeader().dataSize() / encoder.inFormat().mChannelsPerFrame / (encoder.inFormat().mBitsPerChannel / 8);
-    uint32_t full = encoder.sampleSize() / encoder.inFormat().mChannelsPerFrame / (encoder.inFormat().mBitsPerChannel / 8);
-    uint32_t last = (encoder.inputWavHeader().dataSize() / encoder.inFormat().mChannelsPerFrame / (encoder.inFormat().mBitsPerChannel / 8)) - full * (encoder.sampleSizeTable().size() - 1);
-
-    if (last < full) {
-        // Number of entries
-        data << uint32_t(2);
-
-        // Time-to-sample table
-        // Sample count + Sample duration
-        data << uint32_t(encoder.sampleSizeTable().size() - 1);
-        data << uint32_t(full);
-
-        data << uint32_t(1);
-        data << uint32_t(last);
+    // Runs of packets with the same duration: all the full packets and the last one,
+    // or more of them if the packets were split
+    std::vector<std::pair<uint32_t, uint32_t>> entries;
+    for (uint32_t duration : encoder.sampleDurationTable()) {
+        if (!entries.empty() && entries.back().second == duration) {
+            entries.back().first++;
+        }
+        else {
+            entries.emplace_back(1, duration);
+        }
     }
-    else {
-        // Number of entries
-        data << uint32_t(1);
 
-        // Time-to-sample table
-        // Sample count + Sample duration
-        data << uint32_t(encoder.sampleSizeTable().size());
-        data << uint32_t(full);
+    // Number of entries
+    data << uint32_t(entries.size());
+
+    // Time-to-sample table
+    // Sample count + Sample duration
+    for (const auto &entry : entries) {
+        data << uint32_t(entry.first);
+        data << uint32_t(entry.second);
     }
 }
 
@@ -913,7 +948,7 @@ MetaAtom::MetaAtom(const Encoder &encoder)
         ilst.data << DiskAtom(encoder);
     }
 
-    if (!encoder.tags().coverFile().empty()) {
+    if (encoder.tags().hasCover()) {
         CovrAtom covr(encoder);
         ilst.data << covr;
     }
@@ -962,6 +997,15 @@ CovrAtom::CovrAtom(const Encoder &encoder)
     // clang-fornmat on
     dataAtom.data << uint32_t(0); // I don't know what is
 
+    // Append the image of the input file ..................
+    if (encoder.tags().coverFile().empty()) {
+        dataAtom.data << encoder.tags().coverData();
+
+        typeId = "covr";
+        subAtoms << dataAtom;
+        return;
+    }
+
     // Append file data ..................
     auto file = std::ifstream(encoder.tags().coverFile(), std::ios::in | std::ios::binary);
     if (file.fail()) {
@@ -979,5 +1023,137 @@ CovrAtom::CovrAtom(const Encoder &encoder)
     subAtoms << dataAtom;
 }
 
+/************************************************
+ * MvexAtom
+ *
+ * Movie Extends Atom
+ * Tells that the samples are in the movie fragments that follow the moov atom.
+ * See ISO/IEC 14496-12, 8.8.1
+ ************************************************/
+MvexAtom::MvexAtom(const Encoder &encoder)
+{
+    typeId = "mvex";
+
+    Atom trex;
+    trex.typeId = "trex";
+
+    // Version and flags
+    trex.data << uint32_t(0);
+
+    // Track ID
+    trex.data << uint32_t(1);
+
+    // Default sample description index
+    trex.data << uint32_t(1);
+
+    // Default sample duration, size and flags
+    // Every trun atom has the durations and sizes of its samples
+    trex.data << uint32_t(encoder.options().frameSize);
+    trex.data << uint32_t(0);
+    trex.data << uint32_t(0);
+
+    subAtoms << trex;
+}
+
+/************************************************
+ * MoofAtom
+ *
+ * Movie Fragment Atom
+ * Describes the packets of the last fragment, the mdat atom with them follows it.
+ * See ISO/IEC 14496-12, 8.8.4
+ ************************************************/
+MoofAtom::MoofAtom(const Encoder &encoder)
+{
+    typeId = "moof";
+
+    enum TfhdFlag : uint32_t {
+        DefaultBaseIsMoof = 0x020000, // The data offsets of the trun atoms are relative to the moof atom
+    };
+
+    enum TrunFlag : uint32_t {
+        DataOffsetPresent     = 0x000001,
+        SampleDurationPresent = 0x000100,
+        SampleSizePresent     = 0x000200,
+    };
+
+    const Encoder::Fragment &fragment = encoder.fragments().back();
+
+    Atom mfhd;
+    mfhd.typeId = "mfhd";
+    mfhd.data << uint32_t(0);                       // Version and flags
+    mfhd.data << uint32_t(fragment.sequenceNumber); // Sequence number
+
+    Atom tfhd;
+    tfhd.typeId = "tfhd";
+    tfhd.data << uint32_t(TfhdFlag::DefaultBaseIsMoof); // Version 0 and flags
+    tfhd.data << uint32_t(1);                           // Track ID
+
+    Atom tfdt;
+    tfdt.typeId = "tfdt";
+    tfdt.data << uint32_t(1 << 24);             // Version 1 and flags
+    tfdt.data << uint64_t(fragment.decodeTime); // Base media decode time, in samples
+
+    Atom trun;
+    trun.typeId = "trun";
+    trun.data << uint32_t(TrunFlag::DataOffsetPresent | TrunFlag::SampleDurationPresent | TrunFlag::SampleSizePresent); // Version 0 and flags
+    trun.data << uint32_t(encoder.sampleSizeTable().size());                                                            // Sample count
+
+    // Data offset, from the start of the moof atom to the data of the mdat atom
+    uint64_t dataSize = 0;
+    for (uint32_t size : encoder.sampleSizeTable()) {
+        dataSize += size;
+    }
+    const size_t moofSize = 8 + mfhd.size() + 8 + tfhd.size() + tfdt.size() + trun.size() + 4 + encoder.sampleSizeTable().size() * 8;
+    trun.data << uint32_t(moofSize + mdatHeader(dataSize).size());
+
+    for (size_t i = 0; i < encoder.sampleSizeTable().size(); ++i) {
+        trun.data << uint32_t(encoder.sampleDurationTable()[i]);
+        trun.data << uint32_t(encoder.sampleSizeTable()[i]);
+    }
+
+    Atom traf;
+    traf.typeId = "traf";
+    traf.subAtoms << tfhd;
+    traf.subAtoms << tfdt;
+    traf.subAtoms << trun;
+
+    subAtoms << mfhd;
+    subAtoms << traf;
+    assert(size() == moofSize);
+}
+
+/************************************************
+ * MfraAtom
+ *
+ * Movie Fragment Random Access Atom
+ * The positions of the fragments for the players that seek, it closes the file.
+ * See ISO/IEC 14496-12, 8.8.9
+ ************************************************/
+MfraAtom::MfraAtom(const Encoder &encoder)
+{
+    typeId = "mfra";
+
+    Atom tfra;
+    tfra.typeId = "tfra";
+    tfra.data << uint32_t(1 << 24); // Version 1 and flags
+    tfra.data << uint32_t(1);       // Track ID
+    tfra.data << uint32_t(0);       // The traf, trun and sample numbers are 1 byte each
+
+    tfra.data << uint32_t(encoder.fragments().size());
+    for (const Encoder::Fragment &fragment : encoder.fragments()) {
+        tfra.data << uint64_t(fragment.decodeTime);
+        tfra.data << uint64_t(fragment.moofPos);
+        tfra.data << char(1) << char(1) << char(1); // The first sample of the only trun of the only traf
+    }
+
+    Atom mfro;
+    mfro.typeId = "mfro";
+    mfro.data << uint32_t(0);                    // Version and flags
+    mfro.data << uint32_t(8 + tfra.size() + 16); // The size of the mfra atom, the players read it from the end of the file
+
+    subAtoms << tfra;
+    subAtoms << mfro;
+}
+
 
 
@@ -60,9 +60,13 @@ struct Atom
 
 OutFile &operator<<(OutFile &os, const Atom &atom);
 
+// The header of an mdat atom with dataSize bytes of packets, the size is 64-bit when the atom is
+// 4 GiB or larger
+Bytes mdatHeader(uint64_t dataSize);
+
 struct FtypAtom : public Atom
 {
-    FtypAtom();
+    explicit FtypAtom(bool fragmented = false);
 };
 
 struct FreeAtom : public Atom
@@ -99,6 +103,9 @@ struct MetaAtom : public Atom { MetaAtom(const Encoder &encoder); };
 struct CovrAtom : public Atom { CovrAtom(const Encoder &encoder); };
 struct TrknAtom : public Atom { TrknAtom(const Encoder &encoder); };
 struct DiskAtom : public Atom { DiskAtom(const Encoder &encoder); };
+struct MvexAtom : public Atom { MvexAtom(const Encoder &encoder); };
+struct MoofAtom : public Atom { MoofAtom(const Encoder &encoder); };
+struct MfraAtom : public Atom { MfraAtom(const Encoder &encoder); };
 
 // clang-format on
 
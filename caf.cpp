@@ -0,0 +1,239 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)MIT
+ *
+ * Flacon - audio File Encoder
+ * https://github.com/flacon/flacon
+ *
+ * Copyright: 2022
+ *   Alexander Sokoloff <sokoloff.a@gmail.com>
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Alexander Sokoloff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#include "caf.h"
+#include <cstring>
+#include "encoder.h"
+#include "tags.h"
+#include "vendor/alac/codec/ALACAudioTypes.h"
+
+// See https://developer.apple.com/library/archive/documentation/MusicAudio/Reference/CAFSpec/CAF_spec/CAF_spec.html
+
+OutFile &operator<<(OutFile &os, const CafChunk &chunk)
+{
+    Bytes header;
+    header << chunk.typeId.data();
+    header << uint64_t(chunk.data.size());
+
+    os << header;
+    os << chunk.data;
+    return os;
+}
+
+// Writes an integer as a variable length BER one: 7 bits per byte, the high bit set in all the bytes but the last
+static void writeBER(Bytes &out, uint64_t value)
+{
+    char   buf[10];
+    size_t n = 0;
+    do {
+        buf[n++] = char(value & 0x7F);
+        value >>= 7;
+    } while (value > 0);
+
+    while (n > 1) {
+        out << char(buf[--n] | 0x80);
+    }
+    out << buf[0];
+}
+
+/************************************************
+ * File header
+ ************************************************/
+Bytes cafFileHeader()
+{
+    Bytes res;
+    res << "caff";
+
+    // File version
+    res << uint16_t(1);
+
+    // File flags
+    res << uint16_t(0);
+    return res;
+}
+
+/************************************************
+ * Audio Data chunk
+ *
+ * The packets follow the header and the edit count.
+ * The size is -1 if the data chunk is the last chunk in the file
+ * and its size wasn't known when the header was written.
+ ************************************************/
+Bytes cafDataChunkHeader(int64_t packetsSize)
+{
+    Bytes res;
+    res << "data";
+    res << uint64_t(packetsSize < 0 ? -1 : packetsSize + 4);
+
+    // Edit count
+    res << uint32_t(0);
+    return res;
+}
+
+/************************************************
+ * Audio Description chunk
+ ************************************************/
+DescChunk::DescChunk(const Encoder &encoder)
+{
+    typeId = { 'd', 'e', 's', 'c' };
+
+    // Sample rate, 64-bit float
+    double   rate = encoder.inputWavHeader().sampleRate();
+    uint64_t bits;
+    memcpy(&bits, &rate, sizeof(bits));
+    data << bits;
+
+    // Format ID
+    data << "alac";
+
+    // Format flags, the bit depth of the source
+    data << uint32_t(encoder.outFormat().mFormatFlags);
+
+    // Bytes per packet, 0 as they vary
+    data << uint32_t(0);
+
+    // Frames per packet, 0 if they vary: the pakt chunk has the number of every packet then
+    data << uint32_t(encoder.options().adaptiveFrames ? 0 : encoder.outFormat().mFramesPerPacket);
+
+    // Channels per frame
+    data << uint32_t(encoder.outFormat().mChannelsPerFrame);
+
+    // Bits per channel, 0 for the compressed formats
+    data << uint32_t(0);
+}
+
+/************************************************
+ * Channel Layout chunk
+ *
+ * The layouts the ALAC decoder assigns to the channels, the same as in the magic cookie
+ ************************************************/
+ChanChunk::ChanChunk(const Encoder &encoder)
+{
+    typeId = { 'c', 'h', 'a', 'n' };
+
+    // Channel layout tag
+    data << uint32_t(ALACChannelLayoutTags[encoder.outFormat().mChannelsPerFrame - 1]);
+
+    // Channel bitmap, only used with kAudioChannelLayoutTag_UseChannelBitmap
+    data << uint32_t(0);
+
+    // Number of channel descriptions
+    data << uint32_t(0);
+}
+
+/************************************************
+ * Magic Cookie chunk
+ ************************************************/
+KukiChunk::KukiChunk(const Encoder &encoder)
+{
+    typeId = { 'k', 'u', 'k', 'i' };
+    data << encoder.getMagicCookie();
+}
+
+/************************************************
+ * Information chunk
+ *
+ * The tags CAF has keys for, as pairs of null-terminated UTF-8 strings.
+ * The other tags and the cover are left out.
+ ************************************************/
+InfoChunk::InfoChunk(const Encoder &encoder)
+{
+    typeId = { 'i', 'n', 'f', 'o' };
+
+    const Tags &tags = encoder.tags();
+
+    // clang-format off
+    std::vector<std::pair<std::string, std::string>> entries = {
+        { "artist",       tags.artist()      },
+        { "album",        tags.album()       },
+        { "title",        tags.title()       },
+        { "year",         tags.date()        },
+        { "genre",        tags.genre()       },
+        { "comments",     tags.comment()     },
+        { "composer",     tags.songWriter()  },
+        { "track number", tags.trackNum() ? std::to_string(tags.trackNum()) : "" },
+    };
+    // clang-format on
+
+    uint32_t count = 0;
+    Bytes    strings;
+    for (const auto &entry : entries) {
+        if (!entry.second.empty()) {
+            strings << entry.first << '\0' << entry.second << '\0';
+            count++;
+        }
+    }
+
+    // Number of entries
+    data << count;
+    data << strings;
+}
+
+/************************************************
+ * Packet Table chunk
+ *
+ * The sizes of the packets, and the number of frames in every packet
+ * if the desc chunk has 0 frames per packet
+ ************************************************/
+PaktChunk::PaktChunk(const Encoder &encoder)
+{
+    typeId = { 'p', 'a', 'k', 't' };
+
+    const std::vector<uint32_t> &sizes     = encoder.sampleSizeTable();
+    const std::vector<uint32_t> &durations = encoder.sampleDurationTable();
+    const bool                   variable  = encoder.options().adaptiveFrames;
+
+    uint64_t numFrames = 0;
+    for (uint32_t d : durations) {
+        numFrames += d;
+    }
+
+    // Number of packets
+    data << uint64_t(sizes.size());
+
+    // Number of valid frames
+    data << uint64_t(numFrames);
+
+    // Priming frames
+    data << uint32_t(0);
+
+    // Remainder frames, the ones missing in the last packet
+    data << uint32_t(variable ? 0 : sizes.size() * encoder.outFormat().mFramesPerPacket - numFrames);
+
+    for (size_t i = 0; i < sizes.size(); ++i) {
+        writeBER(data, sizes[i]);
+        if (variable) {
+            writeBER(data, durations[i]);
+        }
+    }
+}
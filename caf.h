@@ -0,0 +1,71 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)MIT
+ *
+ * Flacon - audio File Encoder
+ * https://github.com/flacon/flacon
+ *
+ * Copyright: 2022
+ *   Alexander Sokoloff <sokoloff.a@gmail.com>
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Alexander Sokoloff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#ifndef CAF_H
+#define CAF_H
+
+#include <array>
+#include "types.h"
+
+class Encoder;
+
+// A chunk of a Core Audio Format file
+// See https://developer.apple.com/library/archive/documentation/MusicAudio/Reference/CAFSpec/CAF_spec/CAF_spec.html
+struct CafChunk
+{
+    std::array<char, 4> typeId = { ' ', ' ', ' ', ' ' };
+    Bytes               data;
+
+    uint64_t size() const { return 12 + data.size(); }
+};
+
+OutFile &operator<<(OutFile &os, const CafChunk &chunk);
+
+// The file header: 'caff', version and flags
+Bytes cafFileHeader();
+
+// The header of a data chunk with packetsSize bytes of packets, -1 if the size is not known yet;
+// the size doesn't change the length of the header
+Bytes cafDataChunkHeader(int64_t packetsSize);
+
+// clang-format off
+
+struct DescChunk : public CafChunk { DescChunk(const Encoder &encoder); };
+struct ChanChunk : public CafChunk { ChanChunk(const Encoder &encoder); };
+struct KukiChunk : public CafChunk { KukiChunk(const Encoder &encoder); };
+struct InfoChunk : public CafChunk { InfoChunk(const Encoder &encoder); };
+struct PaktChunk : public CafChunk { PaktChunk(const Encoder &encoder); };
+
+// clang-format on
+
+#endif // CAF_H
@@ -0,0 +1,90 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)MIT
+ *
+ * Flacon - audio File Encoder
+ * https://github.com/flacon/flacon
+ *
+ * Copyright: 2022
+ *   Alexander Sokoloff <sokoloff.a@gmail.com>
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Alexander Sokoloff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#include "effortcontroller.h"
+#include <algorithm>
+
+// the weight of the last packet in the average cost of a level
+static constexpr double COST_WEIGHT = 1.0 / 8;
+
+// the packets to measure a level before leaving it, the timings of single packets are noisy
+static constexpr uint32_t DOWN_PACKETS = 4;
+static constexpr uint32_t UP_PACKETS   = 16;
+
+// the cost ratio of a level to the next one until both are measured
+static constexpr double DEFAULT_STEP = 1.5;
+
+// the part of the budget a higher level may take, so that it isn't left again right away
+static constexpr double HEADROOM = 0.9;
+
+EffortController::EffortController(double targetSpeed, int maxLevel, uint32_t sampleRate) :
+    mBudget(1.0 / targetSpeed),
+    mMaxLevel(maxLevel),
+    mSampleRate(sampleRate),
+    mLevel(maxLevel)
+{
+    mStep.fill(DEFAULT_STEP);
+}
+
+void EffortController::update(double seconds, uint32_t numFrames)
+{
+    if (numFrames == 0) {
+        return;
+    }
+
+    double cost = seconds * mSampleRate / numFrames;
+
+    mCost[mLevel] = (mMeasured > 0) ? mCost[mLevel] + COST_WEIGHT * (cost - mCost[mLevel]) : cost;
+    mMeasured++;
+
+    // the load of the machine changes the costs of all the levels alike, but not their ratios: take
+    // the ratio to the previous level once this one is measured, the previous one was measured just before
+    if (mMeasured == UP_PACKETS && mLastLevel >= 0) {
+        int low    = std::min(mLevel, mLastLevel);
+        mStep[low] = mCost[low + 1] / mCost[low];
+    }
+
+    if (mMeasured >= DOWN_PACKETS && mLevel > 0 && mCost[mLevel] > mBudget) {
+        changeLevel(mLevel - 1);
+    }
+    else if (mMeasured >= UP_PACKETS && mLevel < mMaxLevel && mCost[mLevel] * mStep[mLevel] < mBudget * HEADROOM) {
+        changeLevel(mLevel + 1);
+    }
+}
+
+void EffortController::changeLevel(int level)
+{
+    mLastLevel = mLevel;
+    mLevel     = level;
+    mMeasured  = 0;
+}
@@ -0,0 +1,76 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)MIT
+ *
+ * Flacon - audio File Encoder
+ * https://github.com/flacon/flacon
+ *
+ * Copyright: 2022
+ *   Alexander Sokoloff <sokoloff.a@gmail.com>
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Alexander Sokoloff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#ifndef EFFORTCONTROLLER_H
+#define EFFORTCONTROLLER_H
+
+#include <array>
+#include <cstdint>
+#include "vendor/alac/codec/ALACEncoder.h"
+
+// Picks the compression level of every packet so the encoding keeps up with a target speed:
+// one level lower as soon as the packets take longer than the budget, one level higher when
+// the next level is expected to fit into it
+class EffortController
+{
+public:
+    // a number of packets for every level
+    using LevelPackets = std::array<uint64_t, kALACMaxCompressionLevel + 1>;
+
+    // targetSpeed: the seconds of audio to encode per second, maxLevel: the highest level to use
+    EffortController(double targetSpeed, int maxLevel, uint32_t sampleRate);
+
+    int level() const { return mLevel; }
+
+    // the encode time of a packet of numFrames sample frames at level(), may change level()
+    void update(double seconds, uint32_t numFrames);
+
+private:
+    const double   mBudget; // the encode seconds per second of audio
+    const int      mMaxLevel;
+    const uint32_t mSampleRate;
+
+    int      mLevel;
+    int      mLastLevel = -1; // the level before the last change, until the new one is measured
+    uint32_t mMeasured  = 0;  // the packets encoded since the last change
+
+    // the encode seconds per second of audio of every level, as last measured
+    std::array<double, kALACMaxCompressionLevel + 1> mCost {};
+
+    // the cost ratio of the next level to every level
+    std::array<double, kALACMaxCompressionLevel + 1> mStep;
+
+    void changeLevel(int level);
+};
+
+#endif // EFFORTCONTROLLER_H
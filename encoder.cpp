@@ -36,20 +36,128 @@
 #include <fstream>
 #include "types.h"
 #include "atoms.h"
+#include "caf.h"
+#include "aiffheader.h"
+#include "m4areader.h"
 #include <list>
 #include <cstring>
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <thread>
+#include "vendor/alac/codec/kernellib.h"
 
 struct noop
 {
     void operator()(...) const { }
 };
 
+// The bits set in any of the little-endian samples
+static uint32_t orSamples(const char *data, size_t numSamples, uint32_t sampleBytes)
+{
+    const uint8_t *p        = (const uint8_t *)data;
+    uint8_t        bytes[4] = { 0 };
+
+    for (size_t i = 0; i < numSamples; ++i, p += sampleBytes) {
+        for (uint32_t b = 0; b < sampleBytes; ++b) {
+            bytes[b] |= p[b];
+        }
+    }
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (uint32_t(bytes[3]) << 24);
+}
+
+// The ALAC depth that holds samples of the given number of bits
+static uint32_t alacBitDepth(uint32_t bits)
+{
+    // clang-format off
+    if (bits <= 16) return 16;
+    if (bits <= 20) return 20;
+    if (bits <= 24) return 24;
+    return 32;
+    // clang-format on
+}
+
+// Drops the low bytes of the little-endian samples in place
+static void repackSamples(char *data, size_t numSamples, uint32_t fromBytes, uint32_t toBytes)
+{
+    const char *in  = data + (fromBytes - toBytes);
+    char       *out = data;
+
+    for (size_t i = 0; i < numSamples; ++i, in += fromBytes, out += toBytes) {
+        for (uint32_t b = 0; b < toBytes; ++b) {
+            out[b] = in[b];
+        }
+    }
+}
+
+// the samples the conversions below pass to a kernel at once, through a buffer on the stack, as the
+// kernels don't work in place
+static constexpr size_t CONVERT_BLOCK_SAMPLES = 1024;
+
+// Widens the 8-bit unsigned samples to 16-bit signed ones in place, from the end, as they grow
+static void widenSamples(const ALACKernels *kernels, char *data, size_t numSamples)
+{
+    int16_t buf[CONVERT_BLOCK_SAMPLES];
+
+    for (size_t end = numSamples; end > 0;) {
+        size_t begin = end - std::min(end, CONVERT_BLOCK_SAMPLES);
+        kernels->uint8ToInt16((const uint8_t *)data + begin, buf, end - begin);
+        memcpy(data + 2 * begin, buf, 2 * (end - begin));
+        end = begin;
+    }
+}
+
+// Converts the little-endian float samples of sampleBytes bytes to bits-bit integers in place,
+// 3 bytes long; returns the number of the samples that were rounded or clipped
+static uint64_t floatSamplesToInt(const ALACKernels *kernels, char *data, size_t numSamples, uint32_t sampleBytes, uint32_t bits)
+{
+    int32_t  buf[CONVERT_BLOCK_SAMPLES];
+    uint64_t inexact = 0;
+
+    for (size_t begin = 0; begin < numSamples; begin += CONVERT_BLOCK_SAMPLES) {
+        int32_t n = std::min(numSamples - begin, CONVERT_BLOCK_SAMPLES);
+        if (sampleBytes == 4) {
+            inexact += kernels->floatToInt((const float *)(data + 4 * begin), buf, n, bits);
+        }
+        else {
+            inexact += kernels->doubleToInt((const double *)(data + 8 * begin), buf, n, bits);
+        }
+
+        // the integers are left-justified in 3 bytes, e.g. 20 bits
+        char *out = data + 3 * begin;
+        for (int32_t i = 0; i < n; ++i, out += 3) {
+            uint32_t v = uint32_t(buf[i]) << (24 - bits);
+            out[0]     = char(v);
+            out[1]     = char(v >> 8);
+            out[2]     = char(v >> 16);
+        }
+    }
+    return inexact;
+}
+
+// The AIFF files start with FORM, the WAV ones with RIFF, RF64, BW64 or riff
+static WavHeader readHeader(std::istream *in)
+{
+    if (in->peek() == 'F') {
+        return AiffHeader(in);
+    }
+    return WavHeader(in);
+}
+
 Encoder::Encoder(const Options &options) noexcept(false) :
     mOptions(options),
     mInFormat({}),
     mOutFormat({})
 {
+    if (!mOptions.cpu.empty()) {
+        mKernels = ALACFindKernels(mOptions.cpu.c_str());
+        if (!mKernels) {
+            throw Error("--cpu=" + mOptions.cpu + ": unknown or unsupported by this CPU, available: " + availableKernels());
+        }
+    }
+
     if (mOptions.inFile == "-") {
         mInFile.reset(&std::cin, noop());
     }
@@ -61,13 +169,128 @@ Encoder::Encoder(const Options &options) noexcept(false) :
     }
 }
 
+std::string Encoder::availableKernels()
+{
+    const ALACKernels *list[16];
+    int32_t            count = ALACListKernels(list, 16);
+
+    std::string res;
+    for (int32_t i = 0; i < count; ++i) {
+        res += (i ? ", " : "") + std::string(list[i]->name);
+    }
+    return res;
+}
+
+void Encoder::initBitDepth()
+{
+    if (mWavHeader.numChannels() == 0 || mWavHeader.blockAlign() % mWavHeader.numChannels() != 0) {
+        throw Error("Incorrect blockAlign " + std::to_string(mWavHeader.blockAlign()) + " for " + std::to_string(mWavHeader.numChannels()) + " channels");
+    }
+
+    mFileSampleBytes = mWavHeader.blockAlign() / mWavHeader.numChannels();
+    mDroppedBits     = 0;
+
+    // A-law, µ-law and ADPCM samples can be as long as the PCM ones, but they aren't linear
+    WavHeader::Format format = mWavHeader.sampleFormat();
+    if (format != WavHeader::Format_PCM && format != WavHeader::Format_IEEE_FLOAT) {
+        throw Error("Unsupported WAV format " + std::to_string(format) + ", only PCM and IEEE float can be encoded");
+    }
+
+    // the floats made of integers of up to FLOAT_BIT_DEPTH bits convert back exactly
+    if (mWavHeader.isFloat()) {
+        if ((mFileSampleBytes != 4 && mFileSampleBytes != 8) || mWavHeader.bitsPerSample() != mFileSampleBytes * 8) {
+            throw Error("Unsupported float bitsPerSample " + std::to_string(mWavHeader.bitsPerSample()));
+        }
+        mSampleType = (mFileSampleBytes == 4) ? SampleType::Float32 : SampleType::Float64;
+        mBitDepth   = FLOAT_BIT_DEPTH;
+        return;
+    }
+
+    // 16 bits is the lowest ALAC depth
+    if (mFileSampleBytes == 1) {
+        mSampleType = SampleType::UInt8;
+        mBitDepth   = 16;
+        return;
+    }
+
+    if (mFileSampleBytes < 2 || mFileSampleBytes > 4 || mWavHeader.bitsPerSample() > mFileSampleBytes * 8) {
+        throw Error("Unsupported bitsPerSample " + std::to_string(mWavHeader.bitsPerSample()));
+    }
+
+    // the samples are left-justified in their containers, e.g. 20 valid bits in 24
+    const uint32_t containerBits = mFileSampleBytes * 8;
+    uint32_t       bits          = mWavHeader.bitsPerSample();
+    if (mWavHeader.validBitsPerSample() > 0) {
+        bits = std::min<uint32_t>(bits, mWavHeader.validBitsPerSample());
+    }
+
+    if (mOptions.detectDepth) {
+        // the samples tell their depth, whatever the header says
+        bits = scanBitDepth(containerBits - 1);
+    }
+    else if (alacBitDepth(bits) < containerBits && !mM4aInput) {
+        // a header can lie about the valid bits, so they are checked before anything is written; the
+        // standard input can't be read twice, its samples are kept whole
+        if (mOptions.inFile == "-" || scanBitDepth(alacBitDepth(bits)) > alacBitDepth(bits)) {
+            mIgnoredValidBits = bits;
+            bits              = containerBits;
+        }
+    }
+
+    mBitDepth    = alacBitDepth(bits);
+    mDroppedBits = containerBits - mBitDepth;
+}
+
+// Reads the audio data once and returns the number of bits left without the ones that are always zero,
+// stops early once there are more than maxBits
+uint32_t Encoder::scanBitDepth(uint32_t maxBits)
+{
+    if (mOptions.inFile == "-") {
+        throw Error("--detect-depth reads the input twice, it can't be the standard input");
+    }
+
+    std::istream     *in    = mInFile.get();
+    std::streampos    start = in->tellg();
+    std::vector<char> buf(mFileSampleBytes * 64 * 1024);
+    uint64_t          remained = mWavHeader.dataSize();
+    uint32_t          bits     = 0;
+    const uint32_t    lowBits  = (1u << (mFileSampleBytes * 8 - maxBits)) - 1;
+
+    while (remained > 0 && (bits & lowBits) == 0) {
+        size_t size = std::min(uint64_t(buf.size()), remained);
+        in->read(buf.data(), size);
+        if (mWavHeader.isBigEndian()) {
+            swapSamples(buf.data(), in->gcount() / mFileSampleBytes);
+        }
+        bits |= orSamples(buf.data(), in->gcount() / mFileSampleBytes, mFileSampleBytes);
+        remained -= size;
+
+        // a short file is reported by writeAudioData()
+        if (size_t(in->gcount()) < size) {
+            break;
+        }
+    }
+
+    in->clear();
+    in->seekg(start);
+
+    uint32_t zeros = 0;
+    while (zeros < mFileSampleBytes * 8 && (bits & (1u << zeros)) == 0) {
+        zeros++;
+    }
+    return mFileSampleBytes * 8 - zeros;
+}
+
 void Encoder::initInFormat()
 {
+    // 20-bit samples are left-justified in 3 bytes, as in the WAV files
+    uint32_t sampleBytes = (mBitDepth == 20) ? 3 : mBitDepth / 8;
+
     mInFormat.mFormatID         = kALACFormatLinearPCM;
     mInFormat.mSampleRate       = mWavHeader.sampleRate();
-    mInFormat.mBitsPerChannel   = mWavHeader.bitsPerSample();
+    mInFormat.mBitsPerChannel   = sampleBytes * 8;
     mInFormat.mFormatFlags      = kALACFormatFlagIsSignedInteger | kALACFormatFlagIsPacked; // always little endian
-    mInFormat.mBytesPerFrame    = (mWavHeader.bitsPerSample() / 8) * mWavHeader.numChannels();
+    mInFormat.mBytesPerFrame    = sampleBytes * mWavHeader.numChannels();
     mInFormat.mFramesPerPacket  = 1;
     mInFormat.mBytesPerPacket   = mInFormat.mBytesPerFrame * mInFormat.mFramesPerPacket;
     mInFormat.mChannelsPerFrame = mWavHeader.numChannels();
@@ -85,18 +308,18 @@ void Encoder::initOutFormat()
 
     mOutFormat.mFormatID = kALACFormatAppleLossless;
     // clang-format off
-    switch(mWavHeader.bitsPerSample())
+    switch(mBitDepth)
     {
         case 16: mOutFormat.mFormatFlags = Flag_16BitSource; break;
         case 20: mOutFormat.mFormatFlags = Flag_20BitSource; break;
         case 24: mOutFormat.mFormatFlags = Flag_24BitSource; break;
         case 32: mOutFormat.mFormatFlags = Flag_32BitSource; break;
-        default: throw Error("Unsupported bitsPerSample" + std::to_string(mWavHeader.bitsPerSample()));
+        default: throw Error("Unsupported bitsPerSample " + std::to_string(mBitDepth));
     }
     // clang-format on
 
     mOutFormat.mSampleRate       = mWavHeader.sampleRate();
-    mOutFormat.mFramesPerPacket  = kALACDefaultFramesPerPacket;
+    mOutFormat.mFramesPerPacket  = mOptions.frameSize;
     mOutFormat.mChannelsPerFrame = mWavHeader.numChannels();
     mOutFormat.mBytesPerPacket   = 0; // because we are VBR
     mOutFormat.mBytesPerFrame    = 0; // because there are no discernable bits assigned to a particular sample
@@ -104,16 +327,117 @@ void Encoder::initOutFormat()
     mOutFormat.mReserved         = 0;
 }
 
-void Encoder::run()
+void Encoder::initEncoder(ALACEncoder &encoder) const
 {
-    OutFile out = mOptions.outFile == "-" ? OutFile() : OutFile(mOptions.outFile);
-    mWavHeader  = WavHeader(mInFile.get());
+    if (mKernels) {
+        encoder.SetKernels(mKernels);
+    }
+
+    encoder.SetFrameSize(mOutFormat.mFramesPerPacket);
+    encoder.InitializeEncoder(mOutFormat);
+    encoder.SetCompressionLevel(mOptions.fastMode ? kALACMinCompressionLevel : mOptions.compressionLevel);
+    encoder.SetExhaustiveSearch(mOptions.exhaustive);
+}
+
+// The size of the audio data that lasts until the end of the input file
+uint64_t Encoder::fileDataSize()
+{
+    std::istream *in = mInFile.get();
+    in->seekg(0, std::ios::end);
+    uint64_t size = in->tellg();
+    in->seekg(mWavHeader.dataStartPos());
+    return size - std::min(size, mWavHeader.dataStartPos());
+}
+
+// The ALAC track of an MP4 file is decoded into the PCM stream the encoder reads; the tags of the
+// command line replace the ones of the file
+void Encoder::initM4aInput()
+{
+    if (mOptions.inFile == "-") {
+        throw Error("the MP4 input is read in random order, it can't be the standard input");
+    }
+
+    mM4aInput = std::make_shared<M4aReader>(mInFile.get());
+    mInFile   = openInput(std::max(std::thread::hardware_concurrency(), 1u));
+
+    mWavHeader = mM4aInput->wavHeader();
+
+    Tags tags = mM4aInput->tags();
+    tags.merge(mTags);
+    mTags = tags;
+}
+
+// A new stream of the input file, an MP4 one is decoded by numThreads threads
+std::unique_ptr<std::istream> Encoder::openInput(uint32_t numThreads) const
+{
+    std::unique_ptr<std::istream> file(new std::ifstream(mOptions.inFile.c_str(), std::ios::binary));
+    if (file->fail()) {
+        throw Error(mOptions.inFile + ": " + strerror(errno));
+    }
+
+    if (!mM4aInput) {
+        return file;
+    }
+    return std::unique_ptr<std::istream>(new AlacDecodeStream(std::move(file), mM4aInput, numThreads));
+}
+
+void Encoder::init()
+{
+    if (mOptions.rawInput) {
+        mWavHeader = WavHeader(mOptions.rawRate, mOptions.rawBits, mOptions.rawChannels, mOptions.rawBigEndian);
+    }
+    else if (mInFile->peek() == 0) {
+        // the MP4 files start with the size of the ftyp atom
+        initM4aInput();
+    }
+    else {
+        mWavHeader = readHeader(mInFile.get());
+    }
+
+    // a program writing to a pipe can't go back to set the size and may leave it 0, in a file it
+    // means no samples
+    if (mOptions.inFile == "-" && mWavHeader.isDataSizeKnown() && mWavHeader.dataSize() == 0) {
+        mWavHeader.setDataSizeUnknown();
+    }
+
+    // a file can tell the size, the standard input is read until its end by writeAudioData()
+    if (!mWavHeader.isDataSizeKnown() && mOptions.inFile != "-") {
+        mWavHeader.resizeData(fileDataSize());
+    }
+    initBitDepth();
     initInFormat();
     initOutFormat();
+    initEncoder(mEncoder);
+}
+
+void Encoder::run()
+{
+    OutFile out = mOptions.outFile == "-" ? OutFile() : OutFile(mOptions.outFile);
+    init();
 
-    mEncoder.SetFrameSize(mOutFormat.mFramesPerPacket);
-    mEncoder.InitializeEncoder(mOutFormat);
-    mEncoder.SetFastMode(mOptions.fastMode);
+    if (mOptions.format == Format::Caf) {
+        writeCaf(out);
+        return;
+    }
+
+    if (mOptions.format == Format::Raw) {
+        writeRaw(out);
+        return;
+    }
+
+    if (fragmented()) {
+        // the moov atom describes no packets, so it goes first and the fragments follow as they are encoded
+        out << FtypAtom(true);
+        out << MoovAtom(*this);
+        writeAudioData(mInFile.get(), out);
+
+        // the readers of a stream can't seek to the index at its end
+        if (mOptions.outFile != "-") {
+            out << MfraAtom(*this);
+        }
+        out.flush();
+        return;
+    }
 
     out << FtypAtom();
     out << FreeAtom(8);
@@ -122,6 +446,53 @@ void Encoder::run()
     out.flush();
 }
 
+// The packets go straight into a file, the size of the data chunk is set after the packet table
+// is written at the end. A data chunk of unknown size must be the last chunk, so on the standard
+// output, which can't seek, the packets are kept until the packet table is written before them
+void Encoder::writeCaf(OutFile &out)
+{
+    out << cafFileHeader();
+    out << DescChunk(*this);
+    if (mOutFormat.mChannelsPerFrame > 2) {
+        out << ChanChunk(*this);
+    }
+    out << KukiChunk(*this);
+
+    InfoChunk info(*this);
+    if (info.data.size() > 4) {
+        out << info;
+    }
+
+    if (!streamsPackets()) {
+        writeAudioData(mInFile.get(), out);
+        out.flush();
+        return;
+    }
+
+    uint64_t dataPos = out.tellp();
+    out << cafDataChunkHeader(-1);
+    writeAudioData(mInFile.get(), out);
+    uint64_t packetsSize = out.tellp() - dataPos - cafDataChunkHeader(-1).size();
+
+    out << PaktChunk(*this);
+    out.seekp(dataPos);
+    out << cafDataChunkHeader(packetsSize);
+    out.flush();
+}
+
+// The "alac" magic and the magic cookie with its size, then every packet with its size as it
+// is encoded; all the sizes are 32-bit big-endian. There is no container around the packets
+void Encoder::writeRaw(OutFile &out)
+{
+    Bytes cookie = getMagicCookie();
+    out << "alac";
+    out << uint32_t(cookie.size());
+    out << cookie;
+
+    writeAudioData(mInFile.get(), out);
+    out.flush();
+}
+
 std::vector<char> Encoder::getMagicCookie() const
 {
     uint32_t size = mEncoder.GetMagicCookieSize(mWavHeader.numChannels());
@@ -134,7 +505,13 @@ std::vector<char> Encoder::getMagicCookie() const
 
 uint32_t Encoder::sampleSize() const
 {
-    return mInFormat.mChannelsPerFrame * (mInFormat.mBitsPerChannel / 8) * mOutFormat.mFramesPerPacket;
+    return mInFormat.mChannelsPerFrame * mFileSampleBytes * mOutFormat.mFramesPerPacket;
+}
+
+// The samples are converted in place, the buffer of a frame holds it in the file and in mInFormat
+uint32_t Encoder::frameBufferSize() const
+{
+    return std::max(sampleSize(), mInFormat.mBytesPerFrame * mOutFormat.mFramesPerPacket);
 }
 
 void Encoder::setTags(const Tags &value)
@@ -142,6 +519,64 @@ void Encoder::setTags(const Tags &value)
     mTags = value;
 }
 
+// The packets are written as they are encoded, without the OutBuffer
+bool Encoder::streamsPackets() const
+{
+    return mOptions.format == Format::Raw || (mOptions.format == Format::Caf && mOptions.outFile != "-");
+}
+
+// The kernels of the --cpu option or the best ones for the CPU
+const ALACKernels *Encoder::kernels() const
+{
+    return mKernels ? mKernels : ALACGetKernels();
+}
+
+// Converts the big-endian samples of the file into little-endian ones in place
+void Encoder::swapSamples(char *data, size_t numSamples) const
+{
+    kernels()->swapBytes((uint8_t *)data, numSamples, mFileSampleBytes);
+}
+
+// Converts the samples of the file into the ones of mInFormat in place, returns the number of the
+// float samples that were rounded or clipped
+uint64_t Encoder::prepareSamples(char *data, uint32_t numFrames) const
+{
+    size_t numSamples = size_t(numFrames) * mInFormat.mChannelsPerFrame;
+    if (mWavHeader.isBigEndian()) {
+        swapSamples(data, numSamples);
+    }
+
+    switch (mSampleType) {
+        case SampleType::UInt8:
+            widenSamples(kernels(), data, numSamples);
+            return 0;
+
+        case SampleType::Float32:
+        case SampleType::Float64:
+            return floatSamplesToInt(kernels(), data, numSamples, mFileSampleBytes, FLOAT_BIT_DEPTH);
+
+        case SampleType::Int:
+            break;
+    }
+
+    // initBitDepth() has checked that the bits left out are zero
+    if (mFileSampleBytes != mInFormat.mBitsPerChannel / 8) {
+        repackSamples(data, numSamples, mFileSampleBytes, mInFormat.mBitsPerChannel / 8);
+    }
+    return 0;
+}
+
+// Returns the number of packets the frame is encoded in, and their lengths in outLengths
+uint32_t Encoder::splitFrame(ALACEncoder &encoder, char *data, uint32_t numFrames, uint32_t *outLengths) const
+{
+    if (mOptions.adaptiveFrames) {
+        return encoder.SplitFrame(mInFormat, (unsigned char *)data, numFrames, outLengths);
+    }
+
+    outLengths[0] = numFrames;
+    return 1;
+}
+
 class OutBuffer
 {
 public:
@@ -166,6 +601,12 @@ public:
         mData.back().size += size;
     }
 
+    void clear()
+    {
+        mData.resize(1);
+        mData.back().size = 0;
+    }
+
     size_t size() const
     {
         size_t res = 0;
@@ -195,22 +636,44 @@ private:
 
 void Encoder::writeAudioData(std::istream *in, OutFile &out)
 {
+    // a stream without the data size is read until its end, the size is set when it is known
+    const bool    sizeKnown = mWavHeader.isDataSizeKnown();
     const int32_t inBufSize = sampleSize();
-    mSampleSizeTable.reserve(mWavHeader.dataSize() / inBufSize);
-    std::vector<char> inBuf(inBufSize);
+    if (!fragmented() && sizeKnown) {
+        mSampleSizeTable.reserve(mWavHeader.dataSize() / inBufSize);
+    }
+    std::vector<char> inBuf(frameBufferSize());
+
+    // a fragment is closed when the next frame could make it longer than the fragment duration, a
+    // frame longer than the duration makes a fragment of its own
+    const uint64_t fragmentFrames = uint64_t(mOptions.fragmentDuration) * mWavHeader.sampleRate() / 1000;
+    const uint64_t frameFrames    = mOutFormat.mFramesPerPacket;
+    uint64_t       pendingFrames  = 0;
 
     OutBuffer data;
 
-    uint64_t total    = mWavHeader.dataSize();
-    uint64_t remained = total;
-    int      percent  = 0;
+    const uint32_t frameBytes = mFileSampleBytes * mInFormat.mChannelsPerFrame;
+    uint64_t       total      = sizeKnown ? mWavHeader.dataSize() : UINT64_MAX;
+    uint64_t       remained   = total;
+    int            percent    = 0;
+    int            seconds    = 0;
+
+    int                               level = mOptions.fastMode ? kALACMinCompressionLevel : mOptions.compressionLevel;
+    std::unique_ptr<EffortController> effort;
+    if (mOptions.targetSpeed > 0) {
+        effort.reset(new EffortController(mOptions.targetSpeed, level, mWavHeader.sampleRate()));
+    }
 
     while (remained > 0) {
+        if (!sizeKnown && in->eof()) {
+            break;
+        }
+
         if (!in->good()) {
             throw Error(mOptions.inFile + ": " + strerror(errno));
         }
 
-        if (mOptions.showProgress) {
+        if (mOptions.showProgress && sizeKnown) {
             int p = (total - remained) * 100.0 / total;
             if (p > percent) {
                 fprintf(stderr, "  %d%%\r", p);
@@ -218,22 +681,349 @@ void Encoder::writeAudioData(std::istream *in, OutFile &out)
             }
         }
 
+        // without the total, the seconds of the audio read so far
+        if (mOptions.showProgress && !sizeKnown) {
+            int s = (total - remained) / mWavHeader.byteRate();
+            if (s > seconds) {
+                fprintf(stderr, "  %d s\r", s);
+                seconds = s;
+            }
+        }
+
         int32_t readed = std::min(uint64_t(inBufSize), remained);
         in->read(inBuf.data(), readed);
+        if (!sizeKnown) {
+            // the last frame is short, a part of a sample at the end is left out
+            readed = in->gcount() - in->gcount() % frameBytes;
+            if (readed == 0) {
+                break;
+            }
+        }
         remained -= readed;
 
-        int32_t size = readed;
+        uint32_t numFrames = readed / frameBytes;
+        uint32_t lengths[kALACMaxFrameSplits];
+
+        mInexactSamples += prepareSamples(inBuf.data(), numFrames);
+        uint32_t numPackets = splitFrame(mEncoder, inBuf.data(), numFrames, lengths);
 
-        unsigned char *outBuf = data.reserve(mEncoder.maxOutputBytes());
-        mEncoder.Encode(mInFormat, mOutFormat, (unsigned char *)inBuf.data(), outBuf, &size);
-        data.commit(size);
+        unsigned char *packet = (unsigned char *)inBuf.data();
+        for (uint32_t i = 0; i < numPackets; ++i) {
+            int32_t size = lengths[i] * mInFormat.mBytesPerFrame;
 
-        mSampleSizeTable.push_back(size);
+            // only the encoding is timed, a slow output pipe is not a reason to lower the level
+            unsigned char *outBuf = data.reserve(mEncoder.maxOutputBytes());
+            auto           start  = std::chrono::steady_clock::now();
+            mEncoder.Encode(mInFormat, mOutFormat, packet, outBuf, &size);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            if (mOptions.format == Format::Raw) {
+                out << uint32_t(size);
+                out.write(outBuf, size);
+                // a reader of the stream can decode the packet now
+                out.flush();
+            }
+            else if (streamsPackets()) {
+                out.write(outBuf, size);
+            }
+            else {
+                data.commit(size);
+            }
+            mLevelPackets[level]++;
+
+            if (effort) {
+                effort->update(seconds, lengths[i]);
+                if (effort->level() != level) {
+                    level = effort->level();
+                    mEncoder.SetCompressionLevel(level);
+                }
+            }
+            packet += lengths[i] * mInFormat.mBytesPerFrame;
+
+            // nothing describes the packets of a raw stream, keep the memory constant on endless streams
+            if (mOptions.format != Format::Raw) {
+                mSampleSizeTable.push_back(size);
+                mSampleDurationTable.push_back(lengths[i]);
+            }
+            pendingFrames += lengths[i];
+        }
+
+        if (fragmented() && pendingFrames + frameFrames > fragmentFrames) {
+            writeFragment(data, out);
+            pendingFrames = 0;
+        }
+    }
+
+    if (!sizeKnown) {
+        mWavHeader.resizeData(total - remained);
+    }
+
+    if (fragmented()) {
+        if (!mSampleSizeTable.empty()) {
+            writeFragment(data, out);
+        }
+        return;
+    }
+
+    if (streamsPackets()) {
+        return;
     }
 
-    out << uint32_t(data.size() + 8);
-    out << "mdat";
+    if (mOptions.format == Format::Caf) {
+        out << PaktChunk(*this);
+        out << cafDataChunkHeader(data.size());
+        data.write(out);
+        return;
+    }
+
+    out << mdatHeader(data.size());
     mAudioDataStartPos = out.tellp();
 
     data.write(out);
 }
+
+// The size of a fragmented MP4 of the packets of the sample tables as run() writes it: ftyp, the moov
+// atom without packets, the moof/mdat pairs of the fragments as writeAudioData() cuts the frames and,
+// in a file, the mfra index
+uint64_t Encoder::fragmentedSize()
+{
+    const uint64_t fragmentFrames = uint64_t(mOptions.fragmentDuration) * mWavHeader.sampleRate() / 1000;
+    const uint64_t frameFrames    = mOutFormat.mFramesPerPacket;
+
+    std::vector<uint32_t> sizes;
+    std::vector<uint32_t> durations;
+    sizes.swap(mSampleSizeTable);
+    durations.swap(mSampleDurationTable);
+
+    uint64_t res = FtypAtom(true).size() + MoovAtom(*this).size();
+
+    // the fragment of the tables is written as writeFragment() writes it
+    auto addFragment = [this, &res]() {
+        Fragment fragment;
+        fragment.sequenceNumber = mFragments.size() + 1;
+        fragment.moofPos        = res;
+        mFragments.push_back(fragment);
+
+        uint64_t dataSize = std::accumulate(mSampleSizeTable.begin(), mSampleSizeTable.end(), uint64_t(0));
+        res += MoofAtom(*this).size() + mdatHeader(dataSize).size() + dataSize;
+        mSampleSizeTable.clear();
+        mSampleDurationTable.clear();
+    };
+
+    // the packets of a frame add up to the frame size, only the last frame is shorter
+    uint64_t pendingFrames = 0;
+    uint64_t frameLength   = 0;
+    for (size_t i = 0; i < sizes.size(); ++i) {
+        mSampleSizeTable.push_back(sizes[i]);
+        mSampleDurationTable.push_back(durations[i]);
+        frameLength += durations[i];
+        if (frameLength < frameFrames) {
+            continue;
+        }
+
+        pendingFrames += frameLength;
+        frameLength = 0;
+        if (pendingFrames + frameFrames > fragmentFrames) {
+            addFragment();
+            pendingFrames = 0;
+        }
+    }
+    if (!mSampleSizeTable.empty()) {
+        addFragment();
+    }
+
+    if (mOptions.outFile != "-") {
+        res += MfraAtom(*this).size();
+    }
+
+    mFragments.clear();
+    mSampleSizeTable.swap(sizes);
+    mSampleDurationTable.swap(durations);
+    return res;
+}
+
+// Writes the packets in data and the tables as a moof/mdat pair, and clears them
+void Encoder::writeFragment(OutBuffer &data, OutFile &out)
+{
+    Fragment fragment;
+    fragment.sequenceNumber = mFragments.empty() ? 1 : mFragments.back().sequenceNumber + 1;
+    fragment.decodeTime     = mDecodeTime;
+    fragment.moofPos        = out.tellp();
+
+    // the index of the fragments is only written to files, keep the memory constant on endless streams
+    if (mOptions.outFile == "-") {
+        mFragments.clear();
+    }
+    mFragments.push_back(fragment);
+
+    out << MoofAtom(*this);
+    out << mdatHeader(data.size());
+    data.write(out);
+
+    // a reader of the stream can play the fragment now
+    out.flush();
+
+    for (uint32_t duration : mSampleDurationTable) {
+        mDecodeTime += duration;
+    }
+    mSampleSizeTable.clear();
+    mSampleDurationTable.clear();
+    data.clear();
+}
+
+// the fewest frames estimate() encodes, fewer give a rough guess on short files
+static constexpr uint64_t ESTIMATE_MIN_FRAMES = 64;
+
+Encoder::Estimate Encoder::estimate()
+{
+    if (mOptions.inFile == "-") {
+        throw Error("--estimate reads parts of the input, it can't be the standard input");
+    }
+
+    init();
+
+    const uint32_t frameBytes = sampleSize();
+    Estimate       res;
+    res.totalFrames   = (mWavHeader.dataSize() + frameBytes - 1) / frameBytes;
+    res.sampledFrames = std::min(res.totalFrames, std::max(ESTIMATE_MIN_FRAMES, uint64_t(std::ceil(res.totalFrames * mOptions.estimatePart))));
+
+    // a random frame of each of sampledFrames equal parts of the input, a fixed step could fall in
+    // step with the music; the seed is fixed, so the estimate is the same every time
+    std::vector<uint64_t> frames(res.sampledFrames);
+    std::mt19937_64       random(res.totalFrames);
+    for (uint64_t i = 0; i < res.sampledFrames; ++i) {
+        uint64_t first = i * res.totalFrames / res.sampledFrames;
+        uint64_t last  = (i + 1) * res.totalFrames / res.sampledFrames;
+        frames[i]      = first + random() % (last - first);
+    }
+
+    struct Result
+    {
+        uint64_t           inBytes = 0;
+        uint64_t           bytes   = 0;
+        double             seconds = 0;
+        std::exception_ptr error;
+    };
+
+    uint32_t            numThreads = std::min<uint64_t>(std::max(std::thread::hardware_concurrency(), 1u), res.sampledFrames);
+    std::vector<Result> results(numThreads);
+
+    // the packet lengths of every sampled frame, --adaptive-frames splits a frame into several
+    std::vector<std::vector<uint32_t>> splits(res.sampledFrames);
+
+    // every thread reads its frames with its own stream and encodes them with its own encoder
+    auto worker = [&](uint32_t thread) {
+        Result &r = results[thread];
+        try {
+            std::unique_ptr<std::istream> in = openInput(1);
+            ALACEncoder                   encoder;
+            initEncoder(encoder);
+
+            std::vector<char>          inBuf(frameBufferSize());
+            std::vector<unsigned char> outBuf(encoder.maxOutputBytes());
+            uint32_t                   lengths[kALACMaxFrameSplits];
+
+            for (uint64_t i = thread; i < res.sampledFrames; i += numThreads) {
+                uint64_t pos  = frames[i] * frameBytes;
+                uint32_t size = std::min<uint64_t>(frameBytes, mWavHeader.dataSize() - pos);
+
+                in->seekg(mWavHeader.dataStartPos() + pos);
+                in->read(inBuf.data(), size);
+                if (uint32_t(in->gcount()) != size) {
+                    throw Error(mOptions.inFile + ": unexpected end of file");
+                }
+
+                auto     start     = std::chrono::steady_clock::now();
+                uint32_t numFrames = size / (mFileSampleBytes * mInFormat.mChannelsPerFrame);
+                prepareSamples(inBuf.data(), numFrames);
+                uint32_t numPackets = splitFrame(encoder, inBuf.data(), numFrames, lengths);
+
+                unsigned char *packet = (unsigned char *)inBuf.data();
+                for (uint32_t p = 0; p < numPackets; ++p) {
+                    int32_t outSize = lengths[p] * mInFormat.mBytesPerFrame;
+                    encoder.Encode(mInFormat, mOutFormat, packet, outBuf.data(), &outSize);
+                    packet += lengths[p] * mInFormat.mBytesPerFrame;
+                    r.bytes += outSize;
+                }
+
+                splits[i].assign(lengths, lengths + numPackets);
+                r.inBytes += size;
+                r.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+        }
+        catch (...) {
+            r.error = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < numThreads; ++t) {
+        threads.emplace_back(worker, t);
+    }
+
+    uint64_t inBytes = 0;
+    uint64_t bytes   = 0;
+    for (uint32_t t = 0; t < numThreads; ++t) {
+        threads[t].join();
+        inBytes += results[t].inBytes;
+        bytes += results[t].bytes;
+        res.encodeSeconds += results[t].seconds;
+    }
+
+    for (const Result &r : results) {
+        if (r.error) {
+            std::rethrow_exception(r.error);
+        }
+    }
+
+    // the last frame may be short, weigh the frames by their samples
+    double scale = inBytes ? double(mWavHeader.dataSize()) / inBytes : 0;
+    bytes        = std::llround(bytes * scale);
+    res.encodeSeconds *= scale;
+
+    // every frame is split like the sampled frame of its part of the input, so the sample tables get
+    // the packets per frame and the runs of equal durations of the sampled frames
+    uint64_t numSamples = mWavHeader.dataSize() / (mFileSampleBytes * mInFormat.mChannelsPerFrame);
+    mSampleDurationTable.clear();
+    for (uint64_t f = 0; f < res.totalFrames; ++f) {
+        const std::vector<uint32_t> &lengths   = splits[f * res.sampledFrames / res.totalFrames];
+        uint32_t                     numFrames = std::min<uint64_t>(mOutFormat.mFramesPerPacket, numSamples - f * mOutFormat.mFramesPerPacket);
+
+        if (std::accumulate(lengths.begin(), lengths.end(), uint64_t(0)) == numFrames) {
+            mSampleDurationTable.insert(mSampleDurationTable.end(), lengths.begin(), lengths.end());
+        }
+        else {
+            mSampleDurationTable.push_back(numFrames);
+        }
+    }
+
+    // the moov atom of packets of the average size, its sample tables grow with the number of packets
+    uint64_t packets = mSampleDurationTable.size();
+    mSampleSizeTable.assign(packets, packets ? bytes / packets : 0);
+    for (uint64_t i = 0; i < (packets ? bytes % packets : 0); ++i) {
+        mSampleSizeTable[i]++;
+    }
+
+    switch (mOptions.format) {
+        case Format::M4a:
+            // ftyp, free, mdat and moov as run() writes them
+            res.outSize = fragmented() ? fragmentedSize() : FtypAtom().size() + FreeAtom(8).mSize + mdatHeader(bytes).size() + bytes + MoovAtom(*this).size();
+            break;
+
+        case Format::Caf: {
+            // the chunks as writeCaf() writes them
+            InfoChunk info(*this);
+            res.outSize = cafFileHeader().size() + DescChunk(*this).size() + KukiChunk(*this).size();
+            res.outSize += (mOutFormat.mChannelsPerFrame > 2) ? ChanChunk(*this).size() : 0;
+            res.outSize += (info.data.size() > 4) ? info.size() : 0;
+            res.outSize += PaktChunk(*this).size() + cafDataChunkHeader(bytes).size() + bytes;
+            break;
+        }
+
+        case Format::Raw:
+            // the magic, the cookie and the size of every packet as writeRaw() writes them
+            res.outSize = 8 + getMagicCookie().size() + 4 * packets + bytes;
+            break;
+    }
+    return res;
+}
@@ -42,53 +42,194 @@
 #include "vendor/alac/codec/ALACAudioTypes.h"
 #include "vendor/alac/codec/ALACEncoder.h"
 #include "tags.h"
+#include "effortcontroller.h"
+
+class OutBuffer;
+class M4aReader;
 
 class Encoder
 {
 public:
+    enum class Format {
+        M4a,
+        Caf,
+        Raw,
+    };
+
     struct Options
     {
         std::string inFile;
         std::string outFile;
 
+        Format format = Format::M4a;
+
+        // the input is headerless PCM of this format instead of a WAV file
+        bool     rawInput     = false;
+        uint32_t rawRate      = 0;
+        uint16_t rawBits      = 0; // 16, 20 (left-justified in 3 bytes), 24 or 32
+        uint16_t rawChannels  = 0;
+        bool     rawBigEndian = false;
+
         bool showProgress = true;
         bool fastMode     = false;
+
+        // kALACMinCompressionLevel ... kALACMaxCompressionLevel, fastMode is the same as level 0
+        int compressionLevel = kALACDefaultCompressionLevel;
+
+        // try every search candidate instead of stopping once the cost goes up
+        bool exhaustive = false;
+
+        // samples per packet, kALACMinFrameSize ... kALACMaxFrameSize
+        uint32_t frameSize = kALACDefaultFramesPerPacket;
+
+        // split the frames into shorter packets where the signal changes
+        bool adaptiveFrames = false;
+
+        // lower the compression level while the encoding is slower than targetSpeed times realtime,
+        // compressionLevel is the highest level used; 0 keeps the level fixed
+        double targetSpeed = 0;
+
+        // the part of the frames estimate() encodes, more than 0 and at most 1
+        double estimatePart = 0.02;
+
+        // milliseconds of audio per moof/mdat pair of a fragmented MP4, 0 writes a plain one
+        uint32_t fragmentDuration = 0;
+
+        // scan the input for the bits that are always zero and encode at the depth that is left
+        bool detectDepth = false;
+
+        // codec kernels variant, the best one for the CPU if empty
+        std::string cpu;
+    };
+
+    // a moof/mdat pair of a fragmented MP4
+    struct Fragment
+    {
+        uint32_t sequenceNumber = 0; // starts with 1
+        uint64_t decodeTime     = 0; // the sample frames before the fragment
+        uint64_t moofPos        = 0; // the position of the moof atom in the output file
+    };
+
+    // the expected result of run()
+    struct Estimate
+    {
+        uint64_t sampledFrames = 0; // the frames of frameSize samples encoded
+        uint64_t totalFrames   = 0;
+        uint64_t outSize       = 0; // the size of the output file in bytes
+        double   encodeSeconds = 0; // the time to encode the whole input on one core
     };
 
     explicit Encoder(const Options &options) noexcept(false);
 
     void run();
 
+    // encodes options().estimatePart of the frames, spread across the input, on all cores and
+    // scales the result up to the whole input; writes nothing
+    Estimate estimate();
+
+    // comma-separated names of the codec kernels variants supported by this CPU
+    static std::string availableKernels();
+
     Options options() const { return mOptions; }
 
     const std::vector<uint32_t> &sampleSizeTable() const { return mSampleSizeTable; }
 
+    // the number of sample frames in every packet
+    const std::vector<uint32_t> &sampleDurationTable() const { return mSampleDurationTable; }
+
+    // the packets are written in fragments, the tables above only hold the ones of the last fragment
+    bool fragmented() const { return mOptions.fragmentDuration > 0; }
+
+    // the fragments written so far, only the last one when writing to the standard output
+    const std::vector<Fragment> &fragments() const { return mFragments; }
+
     std::vector<char> getMagicCookie() const;
     WavHeader         inputWavHeader() const { return mWavHeader; }
 
-    uint32_t audioDataStartPos() const { return mAudioDataStartPos; }
+    uint64_t audioDataStartPos() const { return mAudioDataStartPos; }
 
     uint32_t sampleSize() const;
 
+    // the ALAC bit depth: 16, 20, 24 or 32
+    uint32_t bitDepth() const { return mBitDepth; }
+
     AudioFormatDescription inFormat() const { return mInFormat; }
+    AudioFormatDescription outFormat() const { return mOutFormat; }
 
     const Tags &tags() const { return mTags; }
     void        setTags(const Tags &value);
 
+    const ALACEncoderStats &stats() const { return mEncoder.GetStats(); }
+
+    // the number of packets encoded at every compression level
+    const EffortController::LevelPackets &levelPackets() const { return mLevelPackets; }
+
+    // the input has float samples, run() converts them to FLOAT_BIT_DEPTH-bit integers
+    bool floatInput() const { return mSampleType == SampleType::Float32 || mSampleType == SampleType::Float64; }
+
+    // the float samples run() has rounded or clipped, 0 if the conversion is lossless
+    uint64_t inexactSamples() const { return mInexactSamples; }
+
+    // the valid bits of the header that weren't used, the samples had more of them or the standard
+    // input couldn't be checked; the samples are encoded at their container size then, 0 otherwise
+    uint32_t ignoredValidBits() const { return mIgnoredValidBits; }
+
+    static constexpr uint32_t FLOAT_BIT_DEPTH = 24;
+
 private:
-    const Options                 mOptions;
-    std::shared_ptr<std::istream> mInFile;
-    WavHeader                     mWavHeader;
-    AudioFormatDescription        mInFormat;
-    AudioFormatDescription        mOutFormat;
-    ALACEncoder                   mEncoder;
-    std::vector<uint32_t>         mSampleSizeTable;
-    uint32_t                      mAudioDataStartPos = 0;
-    Tags                          mTags;
-
-    void initInFormat();
-    void initOutFormat();
-    void writeAudioData(std::istream *in, OutFile &out);
+    // how the samples of the file are converted into the ones of mInFormat
+    enum class SampleType {
+        Int,     // left-justified integers, the low mDroppedBits bits are left out
+        UInt8,   // 8-bit unsigned integers, widened to 16 bits
+        Float32, // IEEE floats, converted to FLOAT_BIT_DEPTH-bit integers
+        Float64,
+    };
+
+    const Options                  mOptions;
+    const ALACKernels             *mKernels = nullptr; // the default ones if null
+    std::shared_ptr<std::istream>  mInFile;
+    WavHeader                      mWavHeader;
+    AudioFormatDescription         mInFormat;
+    AudioFormatDescription         mOutFormat;
+    ALACEncoder                    mEncoder;
+    std::vector<uint32_t>          mSampleSizeTable;
+    std::vector<uint32_t>          mSampleDurationTable;
+    std::vector<Fragment>          mFragments;
+    uint64_t                       mDecodeTime        = 0; // the sample frames of the fragments written so far
+    uint64_t                       mAudioDataStartPos = 0;
+    uint32_t                       mBitDepth          = 0;
+    uint32_t                       mFileSampleBytes   = 0; // the sample container size in the input file
+    uint32_t                       mDroppedBits       = 0; // the low bits of the file samples the ALAC depth leaves out
+    SampleType                     mSampleType        = SampleType::Int;
+    uint64_t                       mInexactSamples    = 0;
+    uint32_t                       mIgnoredValidBits  = 0;
+    Tags                           mTags;
+    EffortController::LevelPackets mLevelPackets {};
+
+    std::shared_ptr<const M4aReader> mM4aInput; // the MP4 file mInFile decodes, if any
+
+    const ALACKernels *kernels() const;
+
+    std::unique_ptr<std::istream> openInput(uint32_t numThreads) const;
+
+    void     init();
+    void     initM4aInput();
+    uint64_t fileDataSize();
+    void     initBitDepth();
+    uint32_t scanBitDepth(uint32_t maxBits);
+    void     initInFormat();
+    void     initOutFormat();
+    void     initEncoder(ALACEncoder &encoder) const;
+    uint32_t frameBufferSize() const;
+    void     swapSamples(char *data, size_t numSamples) const;
+    uint64_t prepareSamples(char *data, uint32_t numFrames) const;
+    uint32_t splitFrame(ALACEncoder &encoder, char *data, uint32_t numFrames, uint32_t *outLengths) const;
+    bool     streamsPackets() const;
+    void     writeAudioData(std::istream *in, OutFile &out);
+    void     writeCaf(OutFile &out);
+    void     writeRaw(OutFile &out);
+    void     writeFragment(OutBuffer &data, OutFile &out);
+    uint64_t fragmentedSize();
 };
 
 #endif // ENCODER_H
@@ -0,0 +1,659 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)MIT
+ *
+ * Flacon - audio File Encoder
+ * https://github.com/flacon/flacon
+ *
+ * Copyright: 2022
+ *   Alexander Sokoloff <sokoloff.a@gmail.com>
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Alexander Sokoloff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#include "m4areader.h"
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <thread>
+#include <utility>
+#include "types.h"
+#include "vendor/alac/codec/ALACDecoder.h"
+#include "vendor/alac/codec/ALACBitUtilities.h"
+
+// the moov atom is read into memory, larger ones are surely broken
+static constexpr uint64_t MAX_MOOV_SIZE = 256 * 1024 * 1024;
+
+// the packets every thread decodes at once
+static constexpr uint32_t PACKETS_PER_THREAD = 16;
+
+// the bit reader of the decoder can look a few bytes past the end of a packet
+static constexpr uint32_t PACKET_PADDING = 8;
+
+/************************************************
+ * A part of the moov atom in memory
+ ************************************************/
+struct Range
+{
+    const uint8_t *begin = nullptr;
+    const uint8_t *end   = nullptr;
+
+    size_t size() const { return end - begin; }
+};
+
+/************************************************
+ *
+ ************************************************/
+static uint16_t readUInt16(const uint8_t *p)
+{
+    return uint16_t((p[0] << 8) | p[1]);
+}
+
+/************************************************
+ *
+ ************************************************/
+static uint32_t readUInt32(const uint8_t *p)
+{
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+/************************************************
+ *
+ ************************************************/
+static uint64_t readUInt64(const uint8_t *p)
+{
+    return (uint64_t(readUInt32(p)) << 32) | readUInt32(p + 4);
+}
+
+/************************************************
+ *
+ ************************************************/
+static void checkSize(const Range &atom, uint64_t size, const char *type)
+{
+    if (atom.size() < size) {
+        throw Error(std::string("[M4A] the ") + type + " atom is too short");
+    }
+}
+
+/************************************************
+ * The child atoms of the parent data: the type and the data
+ * without the header. The size 1 is followed by the 64-bit
+ * size, 0 means the atom lasts until the end of the parent
+ ************************************************/
+static std::vector<std::pair<std::string, Range>> childAtoms(const Range &parent)
+{
+    std::vector<std::pair<std::string, Range>> res;
+
+    const uint8_t *p = parent.begin;
+    while (parent.end - p >= 8) {
+        uint64_t size   = readUInt32(p);
+        uint32_t header = 8;
+        if (size == 1) {
+            if (parent.end - p < 16) {
+                break;
+            }
+            size   = readUInt64(p + 8);
+            header = 16;
+        }
+        else if (size == 0) {
+            size = parent.end - p;
+        }
+
+        if (size < header || size > uint64_t(parent.end - p)) {
+            throw Error("[M4A] incorrect size of the " + std::string((const char *)p + 4, 4) + " atom");
+        }
+
+        res.emplace_back(std::string((const char *)p + 4, 4), Range { p + header, p + size });
+        p += size;
+    }
+    return res;
+}
+
+/************************************************
+ * The data of the first child atom of the type, an empty
+ * range if there is none
+ ************************************************/
+static Range findAtom(const Range &parent, const char *type)
+{
+    for (const auto &atom : childAtoms(parent)) {
+        if (atom.first == type) {
+            return atom.second;
+        }
+    }
+    return Range {};
+}
+
+/************************************************
+ * The path of the child atoms, e.g. "mdia/minf/stbl"
+ ************************************************/
+static Range findPath(Range parent, const std::string &path)
+{
+    for (size_t pos = 0; pos < path.size() && parent.begin; pos += 5) {
+        parent = findAtom(parent, path.substr(pos, 4).c_str());
+    }
+    return parent;
+}
+
+/************************************************
+ * Reads the top level atoms up to the moov one, the mdat atom
+ * is usually before it and is skipped
+ ************************************************/
+static std::vector<uint8_t> readMoov(std::istream *stream)
+{
+    while (true) {
+        uint8_t header[16];
+        if (!stream->read((char *)header, 8)) {
+            throw Error("[M4A] the moov atom not found");
+        }
+
+        uint64_t size       = readUInt32(header);
+        uint32_t headerSize = 8;
+        if (size == 1) {
+            if (!stream->read((char *)header + 8, 8)) {
+                throw Error("[M4A] the moov atom not found");
+            }
+            size       = readUInt64(header + 8);
+            headerSize = 16;
+        }
+
+        if (memcmp(header + 4, "moov", 4) == 0) {
+            if (size < headerSize || size - headerSize > MAX_MOOV_SIZE) {
+                throw Error("[M4A] incorrect size of the moov atom");
+            }
+
+            std::vector<uint8_t> res(size - headerSize);
+            if (!stream->read((char *)res.data(), res.size())) {
+                throw Error("[M4A] unexpected end of file in the moov atom");
+            }
+            return res;
+        }
+
+        // the last atom, up to the end of the file
+        if (size == 0) {
+            throw Error("[M4A] the moov atom not found");
+        }
+
+        if (size < headerSize) {
+            throw Error("[M4A] incorrect size of the " + std::string((const char *)header + 4, 4) + " atom");
+        }
+
+        stream->seekg(size - headerSize, std::ios::cur);
+    }
+}
+
+/************************************************
+ *
+ ************************************************/
+M4aReader::M4aReader(std::istream *stream) noexcept(false)
+{
+    uint8_t ftyp[8];
+    if (!stream->read((char *)ftyp, 8) || memcmp(ftyp + 4, "ftyp", 4) != 0) {
+        throw Error("[M4A] the ftyp atom not found");
+    }
+    stream->seekg(-8, std::ios::cur);
+
+    std::vector<uint8_t> moovData = readMoov(stream);
+    Range                moov { moovData.data(), moovData.data() + moovData.size() };
+
+    if (findAtom(moov, "mvex").begin) {
+        throw Error("[M4A] fragmented files are not supported");
+    }
+
+    for (const auto &atom : childAtoms(moov)) {
+        if (atom.first == "trak") {
+            readTrack(atom.second.begin, atom.second.end);
+        }
+
+        if (!mMagicCookie.empty()) {
+            break;
+        }
+    }
+
+    if (mMagicCookie.empty()) {
+        throw Error("[M4A] the file has no ALAC track");
+    }
+
+    Range meta = findPath(moov, "udta/meta");
+    if (meta.begin) {
+        readTags(meta.begin, meta.end);
+    }
+}
+
+/************************************************
+ * The track with the alac sample description, the
+ * other ones are left as they are
+ ************************************************/
+void M4aReader::readTrack(const uint8_t *begin, const uint8_t *end)
+{
+    Range stbl = findPath(Range { begin, end }, "mdia/minf/stbl");
+    Range stsd = findAtom(stbl, "stsd");
+    if (!stsd.begin) {
+        return;
+    }
+
+    // Version, flags, number of entries and the first entry: size and format
+    checkSize(stsd, 16, "stsd");
+    if (memcmp(stsd.begin + 12, "alac", 4) != 0) {
+        return;
+    }
+
+    // The sound sample description is 28 bytes long, the version 1 adds 16 bytes, the version 2 36.
+    // The first entry lasts until the end of stsd, as some writers leave the chan atom out of its size
+    Range entry { stsd.begin + 16, stsd.end };
+    checkSize(entry, 28, "alac");
+    uint16_t version = readUInt16(entry.begin + 8);
+    uint32_t extra   = (version == 1) ? 16 : (version == 2) ? 36 : 0;
+    checkSize(entry, 28 + extra, "alac");
+
+    // the magic cookie is the ALACSpecificConfig after the version and flags, and the chan atom
+    Range alac = findAtom(Range { entry.begin + 28 + extra, entry.end }, "alac");
+    checkSize(alac, 4 + sizeof(ALACSpecificConfig), "alac");
+    std::vector<uint8_t> cookie(alac.begin + 4, alac.end);
+
+    ALACDecoder decoder;
+    if (decoder.Init(cookie.data(), cookie.size()) != 0) {
+        throw Error("[M4A] unsupported ALAC configuration");
+    }
+    mSampleRate  = decoder.mConfig.sampleRate;
+    mBitDepth    = decoder.mConfig.bitDepth;
+    mNumChannels = decoder.mConfig.numChannels;
+    mFrameLength = decoder.mConfig.frameLength;
+
+    // the durations are in frames only if the time scale is the sample rate
+    // Media header: version, flags, the creation and modification times, 64-bit in the version 1,
+    // and the time scale
+    Range mdhd = findPath(Range { begin, end }, "mdia/mdhd");
+    checkSize(mdhd, 4, "mdhd");
+    uint32_t timeScalePos = (mdhd.begin[0] == 1) ? 20 : 12;
+    checkSize(mdhd, timeScalePos + 4, "mdhd");
+    uint32_t timeScale = readUInt32(mdhd.begin + timeScalePos);
+    if (timeScale != mSampleRate) {
+        throw Error("[M4A] the time scale " + std::to_string(timeScale) + " differs from the sample rate " + std::to_string(mSampleRate));
+    }
+
+    // Sample sizes: version, flags, the size of all the samples or 0, the number of samples and their sizes
+    Range stsz = findAtom(stbl, "stsz");
+    checkSize(stsz, 12, "stsz");
+    uint32_t commonSize = readUInt32(stsz.begin + 4);
+    uint32_t numPackets = readUInt32(stsz.begin + 8);
+    if (commonSize == 0) {
+        checkSize(stsz, 12 + uint64_t(numPackets) * 4, "stsz");
+    }
+
+    // Chunk offsets: version, flags, the number of chunks and their 32- or 64-bit offsets
+    Range    chunkOffsets = findAtom(stbl, "stco");
+    uint32_t offsetBytes  = 4;
+    if (!chunkOffsets.begin) {
+        chunkOffsets = findAtom(stbl, "co64");
+        offsetBytes  = 8;
+    }
+    checkSize(chunkOffsets, 8, "stco");
+    uint32_t numChunks = readUInt32(chunkOffsets.begin + 4);
+    checkSize(chunkOffsets, 8 + uint64_t(numChunks) * offsetBytes, "stco");
+
+    // Sample-to-chunk: version, flags, the number of entries; every entry is the first chunk,
+    // starting from 1, the samples per chunk and the sample description
+    Range stsc = findAtom(stbl, "stsc");
+    checkSize(stsc, 8, "stsc");
+    uint32_t numRuns = readUInt32(stsc.begin + 4);
+    checkSize(stsc, 8 + uint64_t(numRuns) * 12, "stsc");
+
+    // Time-to-sample: version, flags, the number of entries; every entry is the number of samples
+    // and their duration
+    Range stts = findAtom(stbl, "stts");
+    checkSize(stts, 8, "stts");
+    uint32_t numDurations = readUInt32(stts.begin + 4);
+    checkSize(stts, 8 + uint64_t(numDurations) * 8, "stts");
+
+    mPackets.resize(numPackets);
+    uint32_t packet = 0;
+    for (uint32_t run = 0; run < numRuns; ++run) {
+        const uint8_t *p         = stsc.begin + 8 + run * 12;
+        uint32_t       first     = readUInt32(p) - 1;
+        uint32_t       perChunk  = readUInt32(p + 4);
+        uint32_t       nextFirst = (run + 1 < numRuns) ? readUInt32(p + 12) - 1 : numChunks;
+        if (first >= nextFirst || nextFirst > numChunks) {
+            throw Error("[M4A] incorrect stsc atom");
+        }
+
+        for (uint32_t chunk = first; chunk < nextFirst; ++chunk) {
+            const uint8_t *o      = chunkOffsets.begin + 8 + uint64_t(chunk) * offsetBytes;
+            uint64_t       offset = (offsetBytes == 8) ? readUInt64(o) : readUInt32(o);
+
+            for (uint32_t i = 0; i < perChunk; ++i, ++packet) {
+                if (packet >= numPackets) {
+                    throw Error("[M4A] the stsc atom has more samples than the stsz one");
+                }
+                mPackets[packet].offset = offset;
+                mPackets[packet].size   = commonSize ? commonSize : readUInt32(stsz.begin + 12 + packet * 4);
+                offset += mPackets[packet].size;
+            }
+        }
+    }
+
+    if (packet != numPackets) {
+        throw Error("[M4A] the stsc atom has fewer samples than the stsz one");
+    }
+
+    packet = 0;
+    for (uint32_t i = 0; i < numDurations; ++i) {
+        uint32_t count    = readUInt32(stts.begin + 8 + i * 8);
+        uint32_t duration = readUInt32(stts.begin + 12 + i * 8);
+        if (duration > mFrameLength || count > numPackets - packet) {
+            throw Error("[M4A] incorrect stts atom");
+        }
+
+        for (uint32_t k = 0; k < count; ++k, ++packet) {
+            mPackets[packet].firstFrame = mNumFrames;
+            mPackets[packet].numFrames  = duration;
+            mNumFrames += duration;
+        }
+    }
+
+    if (packet != numPackets) {
+        throw Error("[M4A] the stts atom has fewer samples than the stsz one");
+    }
+
+    mMagicCookie = std::move(cookie);
+}
+
+/************************************************
+ * The iTunes tags: every item of the ilst atom has a data atom
+ * with the type, the locale and the value. The text tags, the
+ * track and disc numbers, the compilation flag and the first
+ * cover are kept
+ ************************************************/
+void M4aReader::readTags(const uint8_t *begin, const uint8_t *end)
+{
+    // The meta atom has the version and flags, some writers leave them out
+    Range meta { begin, end };
+    if (meta.size() >= 4 && readUInt32(meta.begin) == 0) {
+        meta.begin += 4;
+    }
+
+    Range ilst = findAtom(meta, "ilst");
+    if (!ilst.begin) {
+        return;
+    }
+
+    for (const auto &item : childAtoms(ilst)) {
+        const std::string &key  = item.first;
+        Range              data = findAtom(item.second, "data");
+        if (data.size() < 8) {
+            continue;
+        }
+
+        uint32_t type = readUInt32(data.begin) & 0xFFFFFF;
+        Range    value { data.begin + 8, data.end };
+
+        // clang-format off
+        if (key == "trkn" && value.size() >= 6) { mTags.setTrackNum(readUInt16(value.begin + 2), readUInt16(value.begin + 4)); continue; }
+        if (key == "disk" && value.size() >= 6) { mTags.setDiscNum(readUInt16(value.begin + 2), readUInt16(value.begin + 4));  continue; }
+        // clang-format on
+
+        if (key == "cpil" && value.size() == 1) {
+            mTags.setCompilation(value.begin[0] != 0);
+            continue;
+        }
+
+        if (key == "covr") {
+            // clang-format off
+            FileType coverType = FileType::Unknown;
+            switch (type) {
+                case 13: coverType = FileType::JPEG; break;
+                case 14: coverType = FileType::PNG;  break;
+                case 27: coverType = FileType::BMP;  break;
+                case 12: coverType = FileType::GIF;  break;
+            }
+            // clang-format on
+
+            if (coverType != FileType::Unknown) {
+                mTags.setCoverData(std::string((const char *)value.begin, value.size()), coverType);
+            }
+            continue;
+        }
+
+        // UTF-8 text, the freeform ---- items have their key in the mean and name atoms
+        if (type == 1 && key != "----") {
+            mTags.setStringTag(key.c_str(), std::string((const char *)value.begin, value.size()));
+        }
+    }
+}
+
+/************************************************
+ *
+ ************************************************/
+WavHeader M4aReader::wavHeader() const
+{
+    WavHeader res(mSampleRate, mBitDepth, mNumChannels, false);
+    res.resizeData(mNumFrames * bytesPerFrame());
+    return res;
+}
+
+/************************************************
+ * The decoded audio of a batch of packets, get area of
+ * the stream buffer
+ ************************************************/
+class AlacDecodeStream::Buffer : public std::streambuf
+{
+public:
+    Buffer(std::shared_ptr<std::istream> file, std::shared_ptr<const M4aReader> reader, uint32_t numThreads);
+
+protected:
+    int_type underflow() override;
+    pos_type seekoff(off_type off, std::ios::seekdir dir, std::ios::openmode which) override;
+    pos_type seekpos(pos_type pos, std::ios::openmode which) override;
+
+private:
+    std::shared_ptr<std::istream>     mFile;
+    std::shared_ptr<const M4aReader>  mReader;
+    std::vector<ALACDecoder>          mDecoders; // one per thread
+    std::vector<std::vector<uint8_t>> mPackets;  // the compressed packets of the batch
+    std::vector<char>                 mData;     // the decoded audio of the batch
+    uint64_t                          mDataPos    = 0; // the stream position of mData
+    size_t                            mNextPacket = 0;
+    uint64_t                          mSkip       = 0; // the bytes to leave out of the next batch after a seek
+
+    void decode(uint32_t thread, size_t first, size_t count);
+};
+
+/************************************************
+ *
+ ************************************************/
+AlacDecodeStream::Buffer::Buffer(std::shared_ptr<std::istream> file, std::shared_ptr<const M4aReader> reader, uint32_t numThreads) :
+    mFile(std::move(file)),
+    mReader(std::move(reader)),
+    mDecoders(std::max(numThreads, 1u))
+{
+    for (ALACDecoder &decoder : mDecoders) {
+        std::vector<uint8_t> cookie = mReader->magicCookie();
+        if (decoder.Init(cookie.data(), cookie.size()) != 0) {
+            throw Error("[M4A] unsupported ALAC configuration");
+        }
+    }
+}
+
+/************************************************
+ * Every thread decodes every numThreads packet of the batch
+ ************************************************/
+void AlacDecodeStream::Buffer::decode(uint32_t thread, size_t first, size_t count)
+{
+    const std::vector<M4aReader::Packet> &packets     = mReader->packets();
+    const uint32_t                        numChannels = mReader->numChannels();
+    const uint32_t                        frameBytes  = mReader->bytesPerFrame();
+    std::vector<uint8_t>                  out(mReader->frameLength() * frameBytes);
+
+    for (size_t i = thread; i < count; i += mDecoders.size()) {
+        const M4aReader::Packet &packet = packets[first + i];
+
+        BitBuffer bits;
+        BitBufferInit(&bits, mPackets[i].data(), packet.size);
+
+        uint32_t numFrames = 0;
+        if (mDecoders[thread].Decode(&bits, out.data(), mReader->frameLength(), numChannels, &numFrames) != 0) {
+            throw Error("[M4A] can't decode the packet " + std::to_string(first + i));
+        }
+
+        if (numFrames != packet.numFrames) {
+            throw Error("[M4A] the packet " + std::to_string(first + i) + " has " + std::to_string(numFrames) + " frames instead of " + std::to_string(packet.numFrames));
+        }
+
+        uint64_t pos = (packet.firstFrame - packets[first].firstFrame) * frameBytes;
+        memcpy(mData.data() + pos, out.data(), numFrames * frameBytes);
+    }
+}
+
+/************************************************
+ * Reads the next batch of packets sequentially and
+ * decodes them in parallel
+ ************************************************/
+AlacDecodeStream::Buffer::int_type AlacDecodeStream::Buffer::underflow()
+{
+    const std::vector<M4aReader::Packet> &packets = mReader->packets();
+    if (mNextPacket >= packets.size()) {
+        return traits_type::eof();
+    }
+
+    const size_t first = mNextPacket;
+    const size_t count = std::min(packets.size() - first, mDecoders.size() * PACKETS_PER_THREAD);
+
+    mPackets.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        const M4aReader::Packet &packet = packets[first + i];
+        mPackets[i].resize(packet.size + PACKET_PADDING);
+
+        mFile->seekg(packet.offset);
+        if (!mFile->read((char *)mPackets[i].data(), packet.size)) {
+            throw Error("[M4A] unexpected end of file in the packet " + std::to_string(first + i));
+        }
+    }
+
+    const M4aReader::Packet &last = packets[first + count - 1];
+    mDataPos                      = packets[first].firstFrame * mReader->bytesPerFrame();
+    mData.resize((last.firstFrame + last.numFrames - packets[first].firstFrame) * mReader->bytesPerFrame());
+
+    uint32_t                        numThreads = std::min<size_t>(mDecoders.size(), count);
+    std::vector<std::exception_ptr> errors(numThreads);
+    std::vector<std::thread>        threads;
+    for (uint32_t t = 1; t < numThreads; ++t) {
+        threads.emplace_back([&, t]() {
+            try {
+                decode(t, first, count);
+            }
+            catch (...) {
+                errors[t] = std::current_exception();
+            }
+        });
+    }
+
+    try {
+        decode(0, first, count);
+    }
+    catch (...) {
+        errors[0] = std::current_exception();
+    }
+
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    for (const std::exception_ptr &error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    mNextPacket = first + count;
+    setg(mData.data(), mData.data() + std::min<uint64_t>(mSkip, mData.size()), mData.data() + mData.size());
+    mSkip = 0;
+
+    if (gptr() == egptr()) {
+        return underflow();
+    }
+    return traits_type::to_int_type(*gptr());
+}
+
+/************************************************
+ *
+ ************************************************/
+AlacDecodeStream::Buffer::pos_type AlacDecodeStream::Buffer::seekoff(off_type off, std::ios::seekdir dir, std::ios::openmode which)
+{
+    // clang-format off
+    uint64_t base = 0;
+    switch (dir) {
+        case std::ios::cur: base = mDataPos + (gptr() - eback()) + mSkip;               break;
+        case std::ios::end: base = mReader->numFrames() * mReader->bytesPerFrame();     break;
+        default:            base = 0;                                                   break;
+    }
+    // clang-format on
+
+    return seekpos(pos_type(off_type(base) + off), which);
+}
+
+/************************************************
+ * The batch is decoded from the packet of the position
+ * by the next underflow()
+ ************************************************/
+AlacDecodeStream::Buffer::pos_type AlacDecodeStream::Buffer::seekpos(pos_type pos, std::ios::openmode which)
+{
+    const uint64_t total = mReader->numFrames() * mReader->bytesPerFrame();
+    if (!(which & std::ios::in) || pos < 0 || uint64_t(pos) > total) {
+        return pos_type(off_type(-1));
+    }
+
+    // already decoded
+    if (uint64_t(pos) >= mDataPos && uint64_t(pos) < mDataPos + (egptr() - eback())) {
+        setg(eback(), eback() + (uint64_t(pos) - mDataPos), egptr());
+        return pos;
+    }
+
+    const std::vector<M4aReader::Packet> &packets = mReader->packets();
+    const uint64_t                        frame   = uint64_t(pos) / mReader->bytesPerFrame();
+
+    auto it = std::upper_bound(packets.begin(), packets.end(), frame, [](uint64_t f, const M4aReader::Packet &p) { return f < p.firstFrame; });
+
+    mNextPacket = (it == packets.begin()) ? 0 : it - packets.begin() - 1;
+    mDataPos    = (mNextPacket < packets.size()) ? packets[mNextPacket].firstFrame * mReader->bytesPerFrame() : total;
+    mSkip       = uint64_t(pos) - mDataPos;
+    setg(nullptr, nullptr, nullptr);
+    return pos;
+}
+
+/************************************************
+ *
+ ************************************************/
+AlacDecodeStream::AlacDecodeStream(std::shared_ptr<std::istream> file, std::shared_ptr<const M4aReader> reader, uint32_t numThreads) noexcept(false) :
+    std::istream(nullptr),
+    mBuffer(new Buffer(std::move(file), std::move(reader), numThreads))
+{
+    rdbuf(mBuffer.get());
+
+    // the decoding errors reach the encoder, not only the badbit
+    exceptions(std::ios::badbit);
+}
+
+/************************************************
+ *
+ ************************************************/
+AlacDecodeStream::~AlacDecodeStream() = default;
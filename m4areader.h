@@ -0,0 +1,110 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)MIT
+ *
+ * Flacon - audio File Encoder
+ * https://github.com/flacon/flacon
+ *
+ * Copyright: 2022
+ *   Alexander Sokoloff <sokoloff.a@gmail.com>
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Alexander Sokoloff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#ifndef M4AREADER_H
+#define M4AREADER_H
+
+#include <istream>
+#include <memory>
+#include <vector>
+#include "tags.h"
+#include "wavheader.h"
+
+/************************************************
+ * Reads the ALAC track of an MP4 file: the magic cookie
+ * from stsd, the packet table from stsz, stco (co64), stsc
+ * and stts, and the tags of the iTunes ilst atom.
+ * See ISO/IEC 14496-12 and
+ *   https://developer.apple.com/library/archive/documentation/QuickTime/QTFF/
+ ************************************************/
+class M4aReader
+{
+public:
+    struct Packet
+    {
+        uint64_t offset     = 0; // in the file
+        uint32_t size       = 0;
+        uint64_t firstFrame = 0; // of the decoded audio
+        uint32_t numFrames  = 0;
+    };
+
+    explicit M4aReader(std::istream *stream) noexcept(false);
+
+    const std::vector<uint8_t> &magicCookie() const { return mMagicCookie; }
+    const std::vector<Packet>  &packets() const { return mPackets; }
+    const Tags                 &tags() const { return mTags; }
+
+    uint32_t sampleRate() const { return mSampleRate; }
+    uint32_t bitDepth() const { return mBitDepth; }
+    uint32_t numChannels() const { return mNumChannels; }
+    uint32_t frameLength() const { return mFrameLength; }
+    uint64_t numFrames() const { return mNumFrames; }
+
+    // the bytes of a decoded frame, 20-bit samples are left-justified in 3 bytes
+    uint32_t bytesPerFrame() const { return (mBitDepth == 20 ? 3 : mBitDepth / 8) * mNumChannels; }
+
+    // the decoded audio as a raw little-endian PCM stream
+    WavHeader wavHeader() const;
+
+private:
+    std::vector<uint8_t> mMagicCookie;
+    std::vector<Packet>  mPackets;
+    Tags                 mTags;
+    uint32_t             mSampleRate  = 0;
+    uint32_t             mBitDepth    = 0;
+    uint32_t             mNumChannels = 0;
+    uint32_t             mFrameLength = 0;
+    uint64_t             mNumFrames   = 0;
+
+    void readTrack(const uint8_t *begin, const uint8_t *end);
+    void readTags(const uint8_t *begin, const uint8_t *end);
+};
+
+/************************************************
+ * The decoded PCM of an M4aReader file. The packets are decoded
+ * in batches, every thread decodes a part of a batch with its
+ * own ALACDecoder, as the ALAC packets don't depend on each
+ * other. Seeking decodes from the packet of the position.
+ ************************************************/
+class AlacDecodeStream : public std::istream
+{
+public:
+    AlacDecodeStream(std::shared_ptr<std::istream> file, std::shared_ptr<const M4aReader> reader, uint32_t numThreads) noexcept(false);
+    ~AlacDecodeStream();
+
+private:
+    class Buffer;
+    std::unique_ptr<Buffer> mBuffer;
+};
+
+#endif // M4AREADER_H
@@ -32,20 +32,27 @@
  * END_COMMON_COPYRIGHT_HEADER */
 
 #include <iostream>
+#include <cstdio>
+#include <set>
+#include <sstream>
 #include "encoder.h"
 #include "vendor/docopt/docopt.h"
 #include "tags.h"
 
 static constexpr auto VERSION_STR = PROJECT_NAME " " PROJECT_VERSION;
 
+static constexpr long MIN_FRAGMENT_DURATION = 1;
+static constexpr long MAX_FRAGMENT_DURATION = 60 * 60 * 1000;
+
 static constexpr auto USAGE_TEXT =
         PROJECT_NAME " - " PROJECT_DESCRIPTION R"(
 
 Usage:
   alacenc [options] [--] <INPUT_FILE> <OUTPUT_FILE>
+  alacenc --estimate [options] [--] <INPUT_FILE>
 
 Arguments:
-  INPUT_FILE        Input file name,
+  INPUT_FILE        Input WAV, AIFF or ALAC m4a file name,
                     when INPUT_FILE is -, read standard input
   OUTPUT_FILE       Output ALAC file name,
                     when OUTPUT_FILE is -, write to standard output
@@ -54,8 +61,54 @@ Options:
   -q --quiet               Produce no output to stderr
   -h --help                Print this help text and exit
   -V --version             Print the version number
-  -f --fast                Fast mode. Encode a channel pair without
-                           the search loop for maximum possible speed
+  -f --fast                Fast mode. Encode all channels without
+                           the search loop for maximum possible speed,
+                           the same as --level=0
+  -l --level=<N>           Compression level from 0 (fastest) to 8
+                           (smallest output), -0 ... -8 are accepted as
+                           shortcuts [default: 5]
+  --exhaustive             Try every stereo mix and predictor order of
+                           the level instead of stopping the search once
+                           the size goes up
+  --speed=<X>              Lower the compression level, down to 0, while
+                           the encoding is slower than X times realtime.
+                           The level of --level is the highest one used
+  --frame-size=<N>         Number of samples per packet from 32 to 16384,
+                           smaller packets lower the decoding latency,
+                           larger ones give slightly smaller files
+                           [default: 4096]
+  --adaptive-frames        Experimental. Split the frames into packets of
+                           1/2, 1/4 or 1/8 of the frame size where the
+                           signal changes
+  --format=<name>          Output format: m4a, caf (Core Audio Format) or
+                           raw (the ALAC packets without a container). The
+                           cover and some of the tags can only be written
+                           to m4a [default: m4a]
+  --fragment=<MS>          Write a fragmented MP4: the header first, then
+                           the audio in fragments of at most MS
+                           milliseconds, or of one frame if it is longer,
+                           as it is encoded, e.g. for live streaming to
+                           standard output
+  --detect-depth           Read the input twice, the first time to find
+                           the low bits that are zero in every sample,
+                           and encode at the bit depth that is left, e.g.
+                           16-bit audio padded to 24 bits as 16-bit
+  --raw                    Read headerless PCM instead of a WAV file, its
+                           format is set with the options below
+  --rate=<HZ>              Sample rate of the raw input
+  --bits=<N>               Bits per sample of the raw input: 16, 20, 24 or
+                           32. 20-bit samples are left-justified in 3 bytes
+  --channels=<N>           Number of channels of the raw input, 1 to 8
+  --endian=<E>             Byte order of the raw input: le (little-endian)
+                           or be (big-endian) [default: le]
+  --estimate               Write no output file, encode a part of the input
+                           and print the expected output size, ratio and
+                           encoding time of the whole file
+  --estimate-part=<P>      Percent of the frames --estimate encodes, spread
+                           across the input [default: 2]
+  --cpu=<name>             Use the given variant of the codec kernels:
+                           scalar, sse4, avx2 or avx512. By default the
+                           fastest one supported by the CPU is used
   --artist=<value>         Set artist name
   --album=<value>          Set album/performer name
   --albumArtist=<value>    Set album artist name
@@ -92,6 +145,291 @@ std::tuple<int, int> splitNums(const std::string &s)
     }
 }
 
+// The options of USAGE_TEXT that take an argument, e.g. -l and --level of "-l --level=<N>"
+static std::set<std::string> optionsWithArgument()
+{
+    std::set<std::string> res;
+    std::istringstream    text(USAGE_TEXT);
+    std::string           line;
+
+    while (std::getline(text, line)) {
+        size_t begin = line.find_first_not_of(' ');
+        if (begin == std::string::npos || line[begin] != '-') {
+            continue;
+        }
+
+        // the names end at the description
+        std::string names = line.substr(begin, line.find("  ", begin) - begin);
+        if (names.find("=<") == std::string::npos) {
+            continue;
+        }
+
+        std::istringstream tokens(names);
+        std::string        token;
+        while (tokens >> token) {
+            res.insert(token.substr(0, token.find('=')));
+        }
+    }
+
+    return res;
+}
+
+// The next argument is the value of this one: "--speed 2", "-l 5" or "-ql 5"; docopt accepts
+// the unambiguous prefixes of the long options as well
+static bool takesValue(const std::string &arg, const std::set<std::string> &withArgument)
+{
+    if (arg.size() < 2 || arg[0] != '-') {
+        return false;
+    }
+
+    if (arg[1] == '-') {
+        if (arg.size() == 2 || arg.find('=') != std::string::npos) {
+            return false;
+        }
+
+        for (const std::string &option : withArgument) {
+            if (option.compare(0, arg.size(), arg) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // the rest of a cluster of short options after the one that takes an argument is its value
+    for (size_t i = 1; i < arg.size(); ++i) {
+        if (withArgument.count(std::string("-") + arg[i])) {
+            return i == arg.size() - 1;
+        }
+    }
+    return false;
+}
+
+// -0 ... -8 are the same as --level=0 ... --level=8, unless they are the value of an option
+static std::vector<std::string> expandLevelShortcuts(int argc, const char **argv)
+{
+    const std::set<std::string> withArgument = optionsWithArgument();
+    std::vector<std::string>    res;
+    bool                        positional = false;
+    bool                        value      = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        positional      = positional || (arg == "--" && !value);
+
+        if (!positional && !value && arg.size() == 2 && arg[0] == '-' && arg[1] >= '0' && arg[1] <= '9') {
+            arg = "--level=" + arg.substr(1);
+        }
+        res.push_back(arg);
+
+        value = !positional && !value && takesValue(arg, withArgument);
+    }
+
+    return res;
+}
+
+static int parseLevel(const std::string &s)
+{
+    int level = -1;
+    try {
+        size_t end;
+        level = std::stoi(s, &end);
+        if (end != s.size()) {
+            level = -1;
+        }
+    }
+    catch (const std::logic_error &) {
+    }
+
+    if (level < kALACMinCompressionLevel || level > kALACMaxCompressionLevel) {
+        throw Error("--level=" + s + ": the compression level must be a number from " + std::to_string(kALACMinCompressionLevel) + " to " + std::to_string(kALACMaxCompressionLevel));
+    }
+    return level;
+}
+
+static uint32_t parseFrameSize(const std::string &s)
+{
+    long size = -1;
+    try {
+        size_t end;
+        size = std::stol(s, &end);
+        if (end != s.size()) {
+            size = -1;
+        }
+    }
+    catch (const std::logic_error &) {
+    }
+
+    if (size < kALACMinFrameSize || size > kALACMaxFrameSize) {
+        throw Error("--frame-size=" + s + ": the frame size must be a number from " + std::to_string(kALACMinFrameSize) + " to " + std::to_string(kALACMaxFrameSize));
+    }
+    return size;
+}
+
+static Encoder::Format parseFormat(const std::string &s)
+{
+    // clang-format off
+    if (s == "m4a") return Encoder::Format::M4a;
+    if (s == "caf") return Encoder::Format::Caf;
+    if (s == "raw") return Encoder::Format::Raw;
+    // clang-format on
+
+    throw Error("--format=" + s + ": the format must be m4a, caf or raw");
+}
+
+// a number from min to max of the --raw input format
+static long parseRawNumber(const std::string &option, const std::string &s, long min, long max)
+{
+    long n = -1;
+    try {
+        size_t end;
+        n = std::stol(s, &end);
+        if (end != s.size()) {
+            n = -1;
+        }
+    }
+    catch (const std::logic_error &) {
+    }
+
+    if (n < min || n > max) {
+        throw Error(option + "=" + s + ": must be a number from " + std::to_string(min) + " to " + std::to_string(max));
+    }
+    return n;
+}
+
+static void parseRawInput(const docopt::Options &args, Encoder::Options &options)
+{
+    const char *formatOptions[] = { "--rate", "--bits", "--channels" };
+    for (const char *option : formatOptions) {
+        if (args.at(option).kind() == docopt::Kind::Empty) {
+            throw Error(std::string("--raw: the ") + option + " option is required");
+        }
+    }
+
+    options.rawInput    = true;
+    options.rawRate     = parseRawNumber("--rate", args.at("--rate").asString(), 1, INT32_MAX);
+    options.rawBits     = parseRawNumber("--bits", args.at("--bits").asString(), 16, 32);
+    options.rawChannels = parseRawNumber("--channels", args.at("--channels").asString(), 1, kALACMaxChannels);
+
+    if (options.rawBits != 16 && options.rawBits != 20 && options.rawBits != 24 && options.rawBits != 32) {
+        throw Error("--bits=" + args.at("--bits").asString() + ": the raw input must have 16, 20, 24 or 32 bits per sample");
+    }
+
+    const std::string endian = args.at("--endian").asString();
+    if (endian != "le" && endian != "be") {
+        throw Error("--endian=" + endian + ": the byte order must be le or be");
+    }
+    options.rawBigEndian = endian == "be";
+}
+
+static uint32_t parseFragmentDuration(const std::string &s)
+{
+    long ms = -1;
+    try {
+        size_t end;
+        ms = std::stol(s, &end);
+        if (end != s.size()) {
+            ms = -1;
+        }
+    }
+    catch (const std::logic_error &) {
+    }
+
+    if (ms < MIN_FRAGMENT_DURATION || ms > MAX_FRAGMENT_DURATION) {
+        throw Error("--fragment=" + s + ": the fragment duration must be a number of milliseconds from " + std::to_string(MIN_FRAGMENT_DURATION) + " to " + std::to_string(MAX_FRAGMENT_DURATION));
+    }
+    return ms;
+}
+
+static double parseSpeed(const std::string &s)
+{
+    double speed = -1;
+    try {
+        size_t end;
+        speed = std::stod(s, &end);
+        if (end != s.size()) {
+            speed = -1;
+        }
+    }
+    catch (const std::logic_error &) {
+    }
+
+    if (!(speed > 0)) {
+        throw Error("--speed=" + s + ": the speed must be a positive number");
+    }
+    return speed;
+}
+
+static double parseEstimatePart(const std::string &s)
+{
+    double percent = -1;
+    try {
+        size_t end;
+        percent = std::stod(s, &end);
+        if (end != s.size()) {
+            percent = -1;
+        }
+    }
+    catch (const std::logic_error &) {
+    }
+
+    if (!(percent > 0 && percent <= 100)) {
+        throw Error("--estimate-part=" + s + ": the part must be a percent above 0 and up to 100");
+    }
+    return percent / 100;
+}
+
+static void printEstimate(const Encoder &enc, const Encoder::Estimate &estimate)
+{
+    const WavHeader &wav     = enc.inputWavHeader();
+    double           seconds = double(wav.dataSize()) / wav.byteRate();
+
+    printf("Frames encoded:  %llu of %llu\n", (unsigned long long)estimate.sampledFrames, (unsigned long long)estimate.totalFrames);
+    printf("Output size:     %llu bytes\n", (unsigned long long)estimate.outSize);
+    printf("Ratio:           %.2f %% of the audio data\n", wav.dataSize() ? 100.0 * estimate.outSize / wav.dataSize() : 0);
+    printf("Encoding time:   %.1f s on one core, %.1f times realtime\n", estimate.encodeSeconds, estimate.encodeSeconds > 0 ? seconds / estimate.encodeSeconds : 0);
+}
+
+// The number of packets encoded at every compression level, when the level changes
+static void printLevelPackets(const Encoder &enc)
+{
+    std::cerr << "Packets per level:";
+    int level = 0;
+    for (uint64_t n : enc.levelPackets()) {
+        if (n > 0) {
+            std::cerr << " " << level << ":" << n;
+        }
+        level++;
+    }
+    std::cerr << std::endl;
+}
+
+// A header that lies about the valid bits doesn't lose samples, they are encoded whole
+static void printIgnoredValidBits(const Encoder &enc, const Encoder::Options &options)
+{
+    if (enc.ignoredValidBits() == 0) {
+        return;
+    }
+
+    const std::string bits = std::to_string(enc.ignoredValidBits()) + " valid bits of the " + (options.rawInput ? "--bits option" : "header");
+    if (options.inFile == "-") {
+        std::cerr << "Warning: the " << bits << " can't be checked on the standard input, the samples were encoded at " << enc.bitDepth() << " bits" << std::endl;
+    }
+    else {
+        std::cerr << "Warning: the samples have more than the " << bits << ", they were encoded at " << enc.bitDepth() << " bits" << std::endl;
+    }
+}
+
+// The float samples round to 24-bit integers, it's lossless only when all of them were such integers
+static void printFloatConversion(const Encoder &enc, bool showProgress)
+{
+    if (enc.inexactSamples() > 0) {
+        std::cerr << "Warning: " << enc.inexactSamples() << " float samples were rounded or clipped to " << Encoder::FLOAT_BIT_DEPTH << "-bit integers" << std::endl;
+    }
+    else if (showProgress) {
+        std::cerr << "The float samples are exact " << Encoder::FLOAT_BIT_DEPTH << "-bit integers, the conversion is lossless" << std::endl;
+    }
+}
+
 static Tags parseTags(const docopt::Options &args)
 {
     Tags res;
@@ -131,7 +469,7 @@ static Tags parseTags(const docopt::Options &args)
 
 int main(int argc, const char **argv)
 {
-    docopt::Options args = docopt::docopt(USAGE_TEXT, { argv + 1, argv + argc }, true, VERSION_STR);
+    docopt::Options args = docopt::docopt(USAGE_TEXT, expandLevelShortcuts(argc, argv), true, VERSION_STR);
 #if 0
     for (auto a : args) {
         std::cerr << a.first << " : ";
@@ -155,15 +493,66 @@ int main(int argc, const char **argv)
 #endif
 
     Encoder::Options options;
-    options.inFile       = args.at("<INPUT_FILE>").asString();
-    options.outFile      = args.at("<OUTPUT_FILE>").asString();
-    options.showProgress = !args.at("--quiet").asBool();
-    options.fastMode     = args.at("--fast").asBool();
+    options.inFile         = args.at("<INPUT_FILE>").asString();
+    options.showProgress   = !args.at("--quiet").asBool();
+    options.fastMode       = args.at("--fast").asBool();
+    options.exhaustive     = args.at("--exhaustive").asBool();
+    options.adaptiveFrames = args.at("--adaptive-frames").asBool();
+    options.detectDepth    = args.at("--detect-depth").asBool();
+
+    if (args.at("<OUTPUT_FILE>").kind() != docopt::Kind::Empty) {
+        options.outFile = args.at("<OUTPUT_FILE>").asString();
+    }
+
+    if (args.at("--cpu").kind() != docopt::Kind::Empty) {
+        options.cpu = args.at("--cpu").asString();
+    }
 
     try {
+        options.compressionLevel = parseLevel(args.at("--level").asString());
+        options.frameSize        = parseFrameSize(args.at("--frame-size").asString());
+
+        options.format = parseFormat(args.at("--format").asString());
+
+        if (args.at("--raw").asBool()) {
+            parseRawInput(args, options);
+        }
+        else if (args.at("--rate").kind() != docopt::Kind::Empty || args.at("--bits").kind() != docopt::Kind::Empty || args.at("--channels").kind() != docopt::Kind::Empty) {
+            throw Error("--rate, --bits and --channels describe the --raw input only");
+        }
+
+        if (args.at("--fragment").kind() != docopt::Kind::Empty) {
+            if (options.format != Encoder::Format::M4a) {
+                throw Error("--fragment: only the m4a files can be fragmented");
+            }
+            options.fragmentDuration = parseFragmentDuration(args.at("--fragment").asString());
+        }
+
+        if (args.at("--speed").kind() != docopt::Kind::Empty) {
+            options.targetSpeed = parseSpeed(args.at("--speed").asString());
+        }
+
+        options.estimatePart = parseEstimatePart(args.at("--estimate-part").asString());
+
         Encoder enc(options);
         enc.setTags(parseTags(args));
+
+        if (args.at("--estimate").asBool()) {
+            printEstimate(enc, enc.estimate());
+            printIgnoredValidBits(enc, options);
+            return 0;
+        }
+
         enc.run();
+        printIgnoredValidBits(enc, options);
+
+        if (enc.floatInput()) {
+            printFloatConversion(enc, options.showProgress);
+        }
+
+        if (options.showProgress && options.targetSpeed > 0) {
+            printLevelPackets(enc);
+        }
     }
     catch (const std::runtime_error &err) {
         std::cerr << "Error: " << err.what() << std::endl;
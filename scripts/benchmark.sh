@@ -0,0 +1,70 @@
+#!/bin/bash
+
+# Encodes the given WAV files with every compression level and prints
+# the throughput and the compression ratio of each level. The throughput
+# is the best of the repeats.
+#
+# Usage: benchmark.sh [-b path/to/alacenc] [-r repeats] [-o "alacenc options"] file.wav [file.wav ...]
+
+set -e
+
+ALACENC="alacenc"
+REPEATS=3
+OPTIONS=""
+
+while getopts "b:r:o:" opt; do
+    case ${opt} in
+        b) ALACENC="${OPTARG}" ;;
+        r) REPEATS="${OPTARG}" ;;
+        o) OPTIONS="${OPTARG}" ;;
+        *) exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+if [ $# -eq 0 ]; then
+    echo "Usage: $(basename $0) [-b path/to/alacenc] [-r repeats] [-o \"alacenc options\"] file.wav [file.wav ...]" >&2
+    exit 1
+fi
+
+TMP_DIR=$(mktemp -d)
+trap 'rm -rf "${TMP_DIR}"' EXIT
+
+IN_SIZE=0
+for f in "$@"; do
+    IN_SIZE=$((IN_SIZE + $(stat -c %s "$f" 2>/dev/null || stat -f %z "$f")))
+done
+
+LEVELS="0 1 2 3 4 5 6 7 8"
+declare -a BEST OUT_SIZE
+
+# the repeats go round all the levels in turn, so that a slow spell of the
+# machine doesn't fall on the repeats of a single level
+for ((r = 0; r < REPEATS; r++)); do
+    for level in ${LEVELS}; do
+        start=$(date +%s%N)
+        i=0
+        for f in "$@"; do
+            "${ALACENC}" -q -${level} ${OPTIONS} "$f" "${TMP_DIR}/${i}.m4a"
+            i=$((i + 1))
+        done
+        elapsed=$(($(date +%s%N) - start))
+        if [ -z "${BEST[${level}]}" ] || [ ${elapsed} -lt ${BEST[${level}]} ]; then
+            BEST[${level}]=${elapsed}
+        fi
+
+        size=0
+        for out in "${TMP_DIR}"/*.m4a; do
+            size=$((size + $(stat -c %s "${out}" 2>/dev/null || stat -f %z "${out}")))
+        done
+        OUT_SIZE[${level}]=${size}
+    done
+done
+
+printf "%-6s %12s %12s %10s\n" "Level" "Time, s" "MiB/s" "Ratio, %"
+
+for level in ${LEVELS}; do
+    awk -v level=${level} -v ns=${BEST[${level}]} -v in_size=${IN_SIZE} -v out_size=${OUT_SIZE[${level}]} 'BEGIN {
+        printf "%-6s %12.3f %12.1f %10.2f\n", level, ns / 1e9, in_size / 1048576 / (ns / 1e9), 100 * out_size / in_size
+    }'
+done
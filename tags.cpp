@@ -67,9 +67,45 @@ void Tags::setBoolTag(const char *tag, bool value)
 void Tags::setCoverFile(const std::string &value, FileType type)
 {
     mCoverFile = value;
+    mCoverData.clear();
     mCoverType = type;
 }
 
+void Tags::setCoverData(const std::string &value, FileType type)
+{
+    mCoverFile.clear();
+    mCoverData = value;
+    mCoverType = type;
+}
+
+void Tags::merge(const Tags &other)
+{
+    for (const auto &tag : other.mStringTags) {
+        mStringTags[tag.first] = tag.second;
+    }
+
+    // a flag left out on the command line is false, it doesn't clear the tag
+    for (const auto &tag : other.mBoolTags) {
+        if (tag.second || mBoolTags.count(tag.first) == 0) {
+            mBoolTags[tag.first] = tag.second;
+        }
+    }
+
+    if (other.mTrackNum) {
+        setTrackNum(other.mTrackNum, other.mTrackCount);
+    }
+
+    if (other.mDiscNum) {
+        setDiscNum(other.mDiscNum, other.mDiscCount);
+    }
+
+    if (other.hasCover()) {
+        mCoverFile = other.mCoverFile;
+        mCoverData = other.mCoverData;
+        mCoverType = other.mCoverType;
+    }
+}
+
 void Tags::setTrackNum(int track, int count)
 {
     mTrackNum   = track;
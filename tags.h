@@ -91,6 +91,15 @@ public:
     FileType    coverType() const { return mCoverType; }
     void        setCoverFile(const std::string &value, FileType type);
 
+    // the image itself, e.g. the cover of an input file, if there is no cover file
+    const std::string &coverData() const { return mCoverData; }
+    void               setCoverData(const std::string &value, FileType type);
+
+    bool hasCover() const { return !mCoverFile.empty() || !mCoverData.empty(); }
+
+    // the tags set in other replace these ones
+    void merge(const Tags &other);
+
     // Bytes asBytes() const;
     const std::map<std::string, std::string> &stringTags() const { return mStringTags; }
     const std::map<std::string, bool>        &boolTags() const { return mBoolTags; }
@@ -106,6 +115,7 @@ private:
     int  mGenre       = 0;
 
     std::string                        mCoverFile;
+    std::string                        mCoverData;
     FileType                           mCoverType = FileType::Unknown;
     std::map<std::string, std::string> mStringTags;
     std::map<std::string, bool>        mBoolTags;
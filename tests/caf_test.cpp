@@ -0,0 +1,225 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)MIT
+ *
+ * Flacon - audio File Encoder
+ * https://github.com/flacon/flacon
+ *
+ * Copyright: 2022
+ *   Alexander Sokoloff <sokoloff.a@gmail.com>
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Alexander Sokoloff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+// Reads the CAF files of alacenc: caf_test <alacenc>. Generated tones are encoded with
+// --format=caf to a file, where the size of the data chunk is set after the packets, and to the
+// standard output, where the packet table comes first; with the frame size and with
+// --adaptive-frames, where every packet has its duration in the packet table. The data chunk must
+// hold the packets of the BER-coded table of the pakt chunk, with the remainder frames of the last
+// packet, and they must decode to the tones.
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "testutils.h"
+
+static const uint32_t NUM_CHANNELS = 2;
+static const uint32_t FRAME_SIZE   = 4096;
+static const uint32_t NUM_FRAMES   = FRAME_SIZE * 10 + 1000;
+
+// A CAF chunk: its type, the position of its data and the size of the data, -1 if unknown
+struct Chunk
+{
+    std::string type;
+    uint64_t    dataPos = 0;
+    int64_t     size    = 0;
+};
+
+// The chunks after the file header, a chunk of unknown size lasts to the end of the file
+static std::vector<Chunk> readChunks(const std::string &name, const std::vector<uint8_t> &file)
+{
+    std::vector<Chunk> res;
+    if (!check(file.size() >= 8 && memcmp(file.data(), "caff", 4) == 0 && readBE16(&file[4]) == 1, "%s: no CAF file header", name.c_str())) {
+        return res;
+    }
+
+    for (uint64_t pos = 8; pos < file.size();) {
+        if (!check(file.size() - pos >= 12, "%s: a part of a chunk header at %llu", name.c_str(), (unsigned long long)pos)) {
+            return {};
+        }
+
+        Chunk chunk;
+        chunk.type    = std::string((const char *)&file[pos], 4);
+        chunk.size    = int64_t(readBE64(&file[pos + 4]));
+        chunk.dataPos = pos + 12;
+        if (chunk.size == -1) {
+            res.push_back(chunk);
+            break;
+        }
+
+        if (!check(chunk.size >= 0 && uint64_t(chunk.size) <= file.size() - chunk.dataPos, "%s: the %s chunk has %lld bytes, more than the file", name.c_str(), chunk.type.c_str(), (long long)chunk.size)) {
+            return {};
+        }
+        res.push_back(chunk);
+        pos = chunk.dataPos + chunk.size;
+    }
+    return res;
+}
+
+// 16-bit tones that start and stop off the frame boundaries, with silence between them, so that
+// --adaptive-frames splits frames
+static std::vector<uint8_t> tones()
+{
+    std::vector<uint8_t> res;
+    for (uint32_t i = 0; i < NUM_FRAMES; ++i) {
+        for (uint32_t c = 0; c < NUM_CHANNELS; ++c) {
+            int16_t v = (i / 1500) % 3 ? int16_t(12000 * std::sin(i * 0.02 * (c + 1)) + (i * 7919 + c * 104729) % 61) : 0;
+            res.push_back(uint8_t(v));
+            res.push_back(uint8_t(uint16_t(v) >> 8));
+        }
+    }
+    return res;
+}
+
+static const Chunk *findChunk(const std::vector<Chunk> &chunks, const std::string &type)
+{
+    for (const Chunk &chunk : chunks) {
+        if (chunk.type == type) {
+            return &chunk;
+        }
+    }
+    return nullptr;
+}
+
+// A BER integer of the packet table: 7 bits per byte, the high bit is set in all but the last byte
+static bool readBER(const uint8_t **p, const uint8_t *end, uint32_t *value)
+{
+    uint64_t res = 0;
+    while (*p < end) {
+        uint8_t byte = *(*p)++;
+        res          = (res << 7) | (byte & 0x7F);
+        if (!(byte & 0x80)) {
+            *value = uint32_t(res);
+            return res <= UINT32_MAX;
+        }
+    }
+    return false;
+}
+
+static void testCaf(const std::string &name, const std::vector<uint8_t> &pcm, bool toStdout, bool adaptive)
+{
+    const std::string args = std::string("-q --format=caf") + (adaptive ? " --adaptive-frames" : "") + " caf.wav " + (toStdout ? "- > " : "") + quote(name + ".caf");
+
+    const int   failures = gFailures;
+    std::string err;
+    int         status = runAlacenc(args, &err);
+    if (!check(status == 0, "%s: alacenc exited with %d: %s", name.c_str(), status, err.c_str())) {
+        return;
+    }
+
+    const std::vector<uint8_t> file   = readFile(name + ".caf");
+    const std::vector<Chunk>   chunks = readChunks(name, file);
+    const Chunk               *desc   = findChunk(chunks, "desc");
+    const Chunk               *kuki   = findChunk(chunks, "kuki");
+    const Chunk               *pakt   = findChunk(chunks, "pakt");
+    const Chunk               *data   = findChunk(chunks, "data");
+    if (!check(desc && kuki && pakt && data, "%s: the desc, kuki, pakt or data chunk is missing", name.c_str())) {
+        return;
+    }
+
+    // the size of the data chunk is set after the packets in a file, the pakt chunk follows them;
+    // on the standard output the packet table comes first
+    check(data->size >= 4, "%s: the data chunk has the size %lld", name.c_str(), (long long)data->size);
+    check(toStdout == (pakt < data), "%s: the pakt chunk is %s the data chunk", name.c_str(), pakt < data ? "before" : "after");
+
+    // desc: the rate, the format, the flags, the bytes and frames per packet, 0 if they vary, and the channels
+    const uint8_t *d = &file[desc->dataPos];
+    check(memcmp(d + 8, "alac", 4) == 0 && readBE32(d + 16) == 0, "%s: the desc chunk isn't of variable-size ALAC packets", name.c_str());
+    check(readBE32(d + 20) == (adaptive ? 0 : FRAME_SIZE), "%s: the desc chunk has %u frames per packet", name.c_str(), readBE32(d + 20));
+    check(readBE32(d + 24) == NUM_CHANNELS, "%s: the desc chunk has %u channels", name.c_str(), readBE32(d + 24));
+
+    // pakt: the numbers of packets and valid frames, the priming and remainder frames, then the size
+    // of every packet, and its frames if they vary
+    const uint8_t *p          = &file[pakt->dataPos];
+    const uint8_t *end        = p + pakt->size;
+    uint64_t       numPackets = readBE64(p);
+    uint64_t       numFrames  = readBE64(p + 8);
+    uint32_t       priming    = readBE32(p + 16);
+    uint32_t       remainder  = readBE32(p + 20);
+    check(numFrames == NUM_FRAMES, "%s: the pakt chunk has %llu valid frames instead of %u", name.c_str(), (unsigned long long)numFrames, NUM_FRAMES);
+    check(priming == 0, "%s: %u priming frames", name.c_str(), priming);
+    check(remainder == (adaptive ? 0 : numPackets * FRAME_SIZE - NUM_FRAMES), "%s: %u remainder frames for %llu packets", name.c_str(), remainder, (unsigned long long)numPackets);
+
+    std::vector<uint32_t> sizes;
+    std::vector<uint32_t> durations;
+    uint64_t              dataSize = 0;
+    uint32_t              numSplit = 0;
+    for (p += 24; sizes.size() < numPackets;) {
+        uint32_t size     = 0;
+        uint32_t duration = FRAME_SIZE;
+        if (!check(readBER(&p, end, &size) && (!adaptive || readBER(&p, end, &duration)), "%s: the packet table ends after %zu of %llu packets", name.c_str(), sizes.size(), (unsigned long long)numPackets)) {
+            return;
+        }
+        if (sizes.size() + 1 == numPackets && !adaptive) {
+            duration -= remainder;
+        }
+        numSplit += duration < FRAME_SIZE && sizes.size() + 1 < numPackets;
+        sizes.push_back(size);
+        durations.push_back(duration);
+        dataSize += size;
+    }
+    check(p == end, "%s: %zu bytes after the packet table", name.c_str(), size_t(end - p));
+    check(!adaptive || numSplit > 0, "%s: --adaptive-frames split no frame", name.c_str());
+
+    // data: the edit count, then the packets
+    check(uint64_t(data->size) == 4 + dataSize, "%s: the data chunk has %lld bytes for %llu bytes of packets", name.c_str(), (long long)data->size, (unsigned long long)dataSize);
+    check(data->dataPos + data->size <= file.size(), "%s: the data chunk ends after the file", name.c_str());
+    if (gFailures > failures) {
+        return;
+    }
+
+    std::vector<uint8_t> cookie(file.begin() + kuki->dataPos, file.begin() + kuki->dataPos + kuki->size);
+    std::vector<uint8_t> decoded = decodePackets(cookie, &file[data->dataPos + 4], sizes, durations);
+    check(decoded == pcm, "%s: %zu bytes decoded, they are not the %zu bytes of the input", name.c_str(), decoded.size(), pcm.size());
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <alacenc>\n", argv[0]);
+        return 2;
+    }
+    gAlacenc = argv[1];
+
+    const std::vector<uint8_t> pcm = tones();
+    writeFile("caf.wav", wavFile(44100, 16, NUM_CHANNELS, pcm));
+
+    testCaf("caf-file", pcm, false, false);
+    testCaf("caf-stdout", pcm, true, false);
+    testCaf("caf-adaptive-file", pcm, false, true);
+    testCaf("caf-adaptive-stdout", pcm, true, true);
+
+    return gFailures ? 1 : 0;
+}
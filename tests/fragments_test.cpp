@@ -0,0 +1,233 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)MIT
+ *
+ * Flacon - audio File Encoder
+ * https://github.com/flacon/flacon
+ *
+ * Copyright: 2022
+ *   Alexander Sokoloff <sokoloff.a@gmail.com>
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Alexander Sokoloff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+// Walks the atoms of the fragmented MP4 files of alacenc: fragments_test <alacenc>. A generated
+// signal is encoded with --fragment to a file and to the standard output, in both
+//   - every moof is followed by its mdat, the sequence numbers count from 1,
+//   - tfdt has the samples of the fragments before it, the fragments last at most the fragment
+//     duration, or a single frame,
+//   - the data offset of trun points at the data of the mdat, the packets fill it and decode to
+//     the signal,
+// the file ends with an mfra atom, its tfra entries give the times and the positions of the moof
+// atoms; the standard output has the same atoms without it. --estimate of the whole input must give
+// the size of the file.
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "testutils.h"
+
+static const uint32_t SAMPLE_RATE       = 44100;
+static const uint32_t NUM_CHANNELS      = 2;
+static const uint32_t FRAGMENT_DURATION = 500; // ms
+static const uint32_t FRAME_SIZE        = 4096;
+
+// A moof atom of the file and what it gives
+struct Fragment
+{
+    Box                   moof;
+    uint64_t              decodeTime = 0;
+    std::vector<uint32_t> sizes;
+    std::vector<uint32_t> durations;
+};
+
+// The magic cookie in the alac atom of the sample entry of stsd, a chan atom may follow it
+static std::vector<uint8_t> magicCookie(const std::vector<uint8_t> &file, const Box &moov)
+{
+    Box box = moov;
+    for (const char *type : { "trak", "mdia", "minf", "stbl", "stsd" }) {
+        box = findBox(file, box, type);
+    }
+    if (!box.size) {
+        return {};
+    }
+
+    // version, flags and the number of entries, then the entry: its size and type and 28 bytes of the
+    // sound description; the alac atom has a version and flags before the cookie
+    const uint64_t alacPos = box.dataPos + 8 + 36;
+    if (alacPos + 12 > box.pos + box.size || memcmp(&file[alacPos + 4], "alac", 4) != 0) {
+        return {};
+    }
+    return std::vector<uint8_t>(file.begin() + alacPos + 12, file.begin() + box.pos + box.size);
+}
+
+// Reads the trun of the moof and checks its atoms, false if they don't describe the mdat after it
+static bool readMoof(const std::string &name, const std::vector<uint8_t> &file, const Box &moof, const Box &mdat, Fragment *fragment)
+{
+    fragment->moof = moof;
+
+    Box mfhd = findBox(file, moof, "mfhd");
+    Box traf = findBox(file, moof, "traf");
+    Box tfhd = findBox(file, traf, "tfhd");
+    Box tfdt = findBox(file, traf, "tfdt");
+    Box trun = findBox(file, traf, "trun");
+    if (!check(mfhd.size && traf.size && tfhd.size && tfdt.size && trun.size, "%s: the moof at %llu misses atoms", name.c_str(), (unsigned long long)moof.pos)) {
+        return false;
+    }
+
+    // tfhd: the data offsets are relative to the moof atom; tfdt: version 1, a 64-bit time
+    check(readBE32(&file[tfhd.dataPos]) == 0x020000, "%s: the tfhd flags of the moof at %llu are %08x", name.c_str(), (unsigned long long)moof.pos, readBE32(&file[tfhd.dataPos]));
+    check(file[tfdt.dataPos] == 1, "%s: tfdt version %u", name.c_str(), file[tfdt.dataPos]);
+    fragment->decodeTime = readBE64(&file[tfdt.dataPos + 4]);
+
+    // trun: the flags, the number of packets, the data offset and the duration and size of every packet
+    const uint8_t *p          = &file[trun.dataPos];
+    uint32_t       numPackets = readBE32(p + 4);
+    uint32_t       dataOffset = readBE32(p + 8);
+    if (!check(readBE32(p) == 0x000301 && 12 + uint64_t(numPackets) * 8 == trun.size - 8, "%s: incorrect trun at %llu", name.c_str(), (unsigned long long)trun.pos)) {
+        return false;
+    }
+
+    uint64_t dataSize = 0;
+    for (uint32_t i = 0; i < numPackets; ++i) {
+        fragment->durations.push_back(readBE32(p + 12 + i * 8));
+        fragment->sizes.push_back(readBE32(p + 16 + i * 8));
+        dataSize += fragment->sizes.back();
+    }
+
+    bool ok = check(moof.pos + dataOffset == mdat.dataPos, "%s: the data offset of the moof at %llu points at %llu, the data of the mdat is at %llu", name.c_str(), (unsigned long long)moof.pos, (unsigned long long)(moof.pos + dataOffset), (unsigned long long)mdat.dataPos);
+    ok      = check(mdat.pos + mdat.size - mdat.dataPos == dataSize, "%s: the packets of the moof at %llu have %llu bytes, its mdat %llu", name.c_str(), (unsigned long long)moof.pos, (unsigned long long)dataSize, (unsigned long long)(mdat.pos + mdat.size - mdat.dataPos)) && ok;
+    return ok;
+}
+
+// Checks the tfra entries of the mfra atom against the fragments
+static void checkMfra(const std::string &name, const std::vector<uint8_t> &file, const Box &mfra, const std::vector<Fragment> &fragments)
+{
+    Box tfra = findBox(file, mfra, "tfra");
+    Box mfro = findBox(file, mfra, "mfro");
+    if (!check(tfra.size && mfro.size, "%s: the mfra atom misses atoms", name.c_str())) {
+        return;
+    }
+    check(readBE32(&file[mfro.dataPos + 4]) == mfra.size, "%s: mfro gives %u bytes, mfra has %llu", name.c_str(), readBE32(&file[mfro.dataPos + 4]), (unsigned long long)mfra.size);
+
+    // version 1: 64-bit times and positions, the traf, trun and sample numbers are a byte each
+    const uint8_t *p          = &file[tfra.dataPos];
+    uint32_t       numEntries = readBE32(p + 12);
+    if (!check(p[0] == 1 && numEntries == fragments.size() && 16 + uint64_t(numEntries) * 19 == tfra.size - 8, "%s: tfra has %u entries for %zu fragments", name.c_str(), numEntries, fragments.size())) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < numEntries; ++i) {
+        const uint8_t *entry = p + 16 + i * 19;
+        check(readBE64(entry) == fragments[i].decodeTime, "%s: the tfra time of fragment %u is %llu, tfdt %llu", name.c_str(), i + 1, (unsigned long long)readBE64(entry), (unsigned long long)fragments[i].decodeTime);
+        check(readBE64(entry + 8) == fragments[i].moof.pos, "%s: the tfra position of fragment %u is %llu, the moof is at %llu", name.c_str(), i + 1, (unsigned long long)readBE64(entry + 8), (unsigned long long)fragments[i].moof.pos);
+    }
+}
+
+static void checkFile(const std::string &name, const std::vector<uint8_t> &pcm, bool hasMfra)
+{
+    const std::vector<uint8_t> file  = readFile(name);
+    const std::vector<Box>     boxes = childBoxes(file, 0, file.size());
+    if (!check(boxes.size() >= 4 && boxes[0].type == "ftyp" && boxes[1].type == "moov", "%s: no ftyp and moov atoms at the start", name.c_str())) {
+        return;
+    }
+
+    const uint64_t        maxFrames = std::max<uint64_t>(uint64_t(FRAGMENT_DURATION) * SAMPLE_RATE / 1000, FRAME_SIZE);
+    std::vector<Fragment> fragments;
+    std::vector<uint8_t>  decoded;
+    const auto            cookie   = magicCookie(file, boxes[1]);
+    uint64_t              numFrames = 0;
+
+    size_t i = 2;
+    for (; i + 1 < boxes.size() && boxes[i].type == "moof"; i += 2) {
+        Fragment fragment;
+        if (!check(boxes[i + 1].type == "mdat", "%s: the moof at %llu is followed by %s", name.c_str(), (unsigned long long)boxes[i].pos, boxes[i + 1].type.c_str()) || !readMoof(name, file, boxes[i], boxes[i + 1], &fragment)) {
+            return;
+        }
+
+        const uint32_t sequenceNumber = readBE32(&file[findBox(file, boxes[i], "mfhd").dataPos + 4]);
+        check(sequenceNumber == fragments.size() + 1, "%s: the sequence number of fragment %zu is %u", name.c_str(), fragments.size() + 1, sequenceNumber);
+        check(fragment.decodeTime == numFrames, "%s: the tfdt of fragment %zu is %llu instead of %llu", name.c_str(), fragments.size() + 1, (unsigned long long)fragment.decodeTime, (unsigned long long)numFrames);
+
+        uint64_t duration = 0;
+        for (uint32_t d : fragment.durations) {
+            duration += d;
+        }
+        check(duration <= maxFrames, "%s: fragment %zu has %llu samples, more than %u ms", name.c_str(), fragments.size() + 1, (unsigned long long)duration, FRAGMENT_DURATION);
+        numFrames += duration;
+
+        std::vector<uint8_t> packets = decodePackets(cookie, &file[boxes[i + 1].dataPos], fragment.sizes, fragment.durations);
+        check(!packets.empty(), "%s: the packets of fragment %zu can't be decoded", name.c_str(), fragments.size() + 1);
+        decoded.insert(decoded.end(), packets.begin(), packets.end());
+        fragments.push_back(fragment);
+    }
+
+    check(decoded == pcm, "%s: %zu bytes decoded, they are not the %zu bytes of the input", name.c_str(), decoded.size(), pcm.size());
+
+    if (hasMfra) {
+        if (check(i + 1 == boxes.size() && boxes[i].type == "mfra", "%s: the file doesn't end with an mfra atom after the fragments", name.c_str())) {
+            checkMfra(name, file, boxes[i], fragments);
+        }
+    }
+    else {
+        check(i == boxes.size(), "%s: a %s atom after the fragments", name.c_str(), i < boxes.size() ? boxes[i].type.c_str() : "");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <alacenc>\n", argv[0]);
+        return 2;
+    }
+    gAlacenc = argv[1];
+
+    const std::vector<uint8_t> pcm      = testSignal(16, NUM_CHANNELS, SAMPLE_RATE * 3 + 1000, 1);
+    const std::string          fragment = "-q --fragment=" + std::to_string(FRAGMENT_DURATION);
+    writeFile("fragments.wav", wavFile(SAMPLE_RATE, 16, NUM_CHANNELS, pcm));
+
+    std::string err;
+    int         status = runAlacenc(fragment + " fragments.wav fragments-file.m4a", &err);
+    if (check(status == 0, "alacenc exited with %d: %s", status, err.c_str())) {
+        checkFile("fragments-file.m4a", pcm, true);
+    }
+
+    // the estimate of all the frames is the size of the file, the atoms of the fragments and mfra included
+    status = runAlacenc("--estimate --estimate-part=1 --fragment=" + std::to_string(FRAGMENT_DURATION) + " fragments.wav > fragments.estimate", &err);
+    if (check(status == 0, "alacenc --estimate exited with %d: %s", status, err.c_str())) {
+        const std::vector<uint8_t> text     = readFile("fragments.estimate");
+        const std::string          estimate(text.begin(), text.end());
+        const size_t               pos      = estimate.find("Output size:");
+        const unsigned long long   expected = readFile("fragments-file.m4a").size();
+        unsigned long long         size     = 0;
+        check(pos != std::string::npos && sscanf(estimate.c_str() + pos, "Output size: %llu", &size) == 1 && size == expected, "the estimated size is %llu instead of %llu", size, expected);
+    }
+
+    status = runAlacenc(fragment + " - - < fragments.wav > fragments-stdout.m4a", &err);
+    if (check(status == 0, "alacenc exited with %d on the standard output: %s", status, err.c_str())) {
+        checkFile("fragments-stdout.m4a", pcm, false);
+    }
+
+    return gFailures ? 1 : 0;
+}
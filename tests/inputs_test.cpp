@@ -0,0 +1,117 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)MIT
+ *
+ * Flacon - audio File Encoder
+ * https://github.com/flacon/flacon
+ *
+ * Copyright: 2022
+ *   Alexander Sokoloff <sokoloff.a@gmail.com>
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Alexander Sokoloff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+// Encodes an input file of tests/data with alacenc and compares the decoded output with the PCM it
+// must give: inputs_test <alacenc> <name> <input> <expected.pcm> <ALAC bit depth> [options], the
+// output is <name>.m4a, the options are
+//   --stdin            the input is read from the standard input
+//   --warning=<text>   alacenc must warn with the text, it mustn't print anything else
+//   --arg=<option>     an option of alacenc, e.g. --arg=--detect-depth
+//   --rate=<Hz>        the sample rate the output must have
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "m4areader.h"
+#include "testutils.h"
+
+int main(int argc, char **argv)
+{
+    if (argc < 6) {
+        fprintf(stderr, "usage: %s <alacenc> <name> <input> <expected.pcm> <bit depth> [options]\n", argv[0]);
+        return 2;
+    }
+
+    gAlacenc = argv[1];
+
+    const std::string          name     = argv[2];
+    const std::string          in       = argv[3];
+    const std::vector<uint8_t> expected = readFile(argv[4]);
+    const uint32_t             bitDepth = std::atoi(argv[5]);
+    const std::string          out      = name + ".m4a";
+
+    bool        useStdin   = false;
+    uint32_t    sampleRate = 0;
+    std::string warning;
+    std::string args = "-q";
+    for (int i = 6; i < argc; ++i) {
+        if (strcmp(argv[i], "--stdin") == 0) {
+            useStdin = true;
+        }
+        else if (strncmp(argv[i], "--warning=", 10) == 0) {
+            warning = argv[i] + 10;
+        }
+        else if (strncmp(argv[i], "--arg=", 6) == 0) {
+            args += " " + std::string(argv[i] + 6);
+        }
+        else if (strncmp(argv[i], "--rate=", 7) == 0) {
+            sampleRate = std::atoi(argv[i] + 7);
+        }
+    }
+
+    std::string err;
+    int         status = runAlacenc(args + " " + (useStdin ? "- " + quote(out) + " < " + quote(in) : quote(in) + " " + quote(out)), &err);
+    if (!check(status == 0, "%s: alacenc exited with %d: %s", name.c_str(), status, err.c_str())) {
+        return 1;
+    }
+
+    if (warning.empty()) {
+        check(err.empty(), "%s: unexpected output: %s", name.c_str(), err.c_str());
+    }
+    else {
+        check(err.find(warning) != std::string::npos, "%s: no warning \"%s\" in: %s", name.c_str(), warning.c_str(), err.c_str());
+    }
+
+    uint32_t                   depth   = 0;
+    const std::vector<uint8_t> decoded = decodeM4a(out, 1, &depth);
+    check(depth == bitDepth, "%s: encoded at %u bits instead of %u", name.c_str(), depth, bitDepth);
+
+    if (sampleRate) {
+        std::ifstream file(out, std::ios::binary);
+        uint32_t      rate = M4aReader(&file).sampleRate();
+        check(rate == sampleRate, "%s: the sample rate is %u instead of %u", name.c_str(), rate, sampleRate);
+    }
+
+    if (check(decoded.size() == expected.size(), "%s: %zu bytes decoded instead of %zu", name.c_str(), decoded.size(), expected.size())) {
+        for (size_t i = 0; i < decoded.size(); ++i) {
+            if (!check(decoded[i] == expected[i], "%s: the decoded byte %zu is %u instead of %u", name.c_str(), i, decoded[i], expected[i])) {
+                break;
+            }
+        }
+    }
+
+    return gFailures ? 1 : 0;
+}
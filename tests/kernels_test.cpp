@@ -0,0 +1,361 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)MIT
+ *
+ * Flacon - audio File Encoder
+ * https://github.com/flacon/flacon
+ *
+ * Copyright: 2022
+ *   Alexander Sokoloff <sokoloff.a@gmail.com>
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Alexander Sokoloff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+// Runs every codec kernels variant the CPU supports on random and edge-case buffers and compares
+// the results with the scalar variant byte by byte
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+#include "vendor/alac/codec/kernellib.h"
+#include "vendor/alac/codec/ALACBitUtilities.h"
+
+static const int32_t LENGTHS[] = { 1, 2, 3, 7, 16, 31, 33, 64, 255, 1001, 4096 };
+
+static const ALACKernels *gScalar   = nullptr;
+static const ALACKernels *gVariant  = nullptr;
+static int                gFailures = 0;
+static std::mt19937       gRandom(1);
+
+// the ways the test buffers are filled
+enum class Fill {
+    Random,    // uniform over the full range
+    FullScale, // the lowest and the highest values only
+    Small,     // around zero
+};
+
+static const Fill FILLS[] = { Fill::Random, Fill::FullScale, Fill::Small };
+
+static int32_t value(Fill fill, int32_t lo, int32_t hi)
+{
+    switch (fill) {
+        case Fill::FullScale:
+            return (gRandom() & 1) ? hi : lo;
+        case Fill::Small:
+            return std::uniform_int_distribution<int32_t>(std::max(lo, -4), std::min(hi, 4))(gRandom);
+        default:
+            return std::uniform_int_distribution<int32_t>(lo, hi)(gRandom);
+    }
+}
+
+// the bits-bit signed values
+static std::vector<int32_t> values(Fill fill, size_t count, uint32_t bits)
+{
+    const int32_t        hi = int32_t((uint32_t(1) << (bits - 1)) - 1);
+    std::vector<int32_t> res(count);
+    for (int32_t &v : res) {
+        v = value(fill, -hi - 1, hi);
+    }
+    return res;
+}
+
+// the values left-justified in little-endian containers of sampleBytes bytes
+static std::vector<uint8_t> pack(const std::vector<int32_t> &samples, uint32_t bits, uint32_t sampleBytes)
+{
+    std::vector<uint8_t> res(samples.size() * sampleBytes);
+    for (size_t i = 0; i < samples.size(); ++i) {
+        uint32_t v = uint32_t(samples[i]) << (sampleBytes * 8 - bits);
+        for (uint32_t b = 0; b < sampleBytes; ++b) {
+            res[i * sampleBytes + b] = uint8_t(v >> (8 * b));
+        }
+    }
+    return res;
+}
+
+template <typename T>
+static void check(const std::vector<T> &expected, const std::vector<T> &actual, const std::string &what)
+{
+    if (expected.size() != actual.size() || memcmp(expected.data(), actual.data(), expected.size() * sizeof(T)) != 0) {
+        fprintf(stderr, "FAIL %s: %s differs from scalar\n", gVariant->name, what.c_str());
+        gFailures++;
+    }
+}
+
+static void check(int64_t expected, int64_t actual, const std::string &what)
+{
+    if (expected != actual) {
+        fprintf(stderr, "FAIL %s: %s returned %lld instead of %lld\n", gVariant->name, what.c_str(), (long long)actual, (long long)expected);
+        gFailures++;
+    }
+}
+
+static std::string name(const char *kernel, int32_t n, Fill fill)
+{
+    return std::string(kernel) + " n=" + std::to_string(n) + " fill=" + std::to_string(int(fill));
+}
+
+/************************************************
+ * mix16/20/24/32: stereo pairs out of 2 and 6 channels, every
+ * mixRes of the default mixBits and every bytesShifted
+ ************************************************/
+static void testMix(int32_t n, Fill fill)
+{
+    static const int32_t MIX_BITS = 2;
+
+    for (uint32_t stride : { 2u, 6u }) {
+        for (int32_t mixres = 0; mixres <= (1 << MIX_BITS); ++mixres) {
+            const std::string what = name("mix", n, fill) + " stride=" + std::to_string(stride) + " mixres=" + std::to_string(mixres);
+
+            std::vector<int32_t> u1(n), v1(n), u2(n), v2(n);
+
+            std::vector<int32_t> s16  = values(fill, n * stride, 16);
+            std::vector<int16_t> in16(s16.begin(), s16.end());
+            gScalar->mix16(in16.data(), stride, u1.data(), v1.data(), n, MIX_BITS, mixres);
+            gVariant->mix16(in16.data(), stride, u2.data(), v2.data(), n, MIX_BITS, mixres);
+            check(u1, u2, what + " mix16 u");
+            check(v1, v2, what + " mix16 v");
+
+            std::vector<uint8_t> in20 = pack(values(fill, n * stride, 20), 20, 3);
+            gScalar->mix20(in20.data(), stride, u1.data(), v1.data(), n, MIX_BITS, mixres);
+            gVariant->mix20(in20.data(), stride, u2.data(), v2.data(), n, MIX_BITS, mixres);
+            check(u1, u2, what + " mix20 u");
+            check(v1, v2, what + " mix20 v");
+
+            for (int32_t shifted = 0; shifted <= 2; ++shifted) {
+                const std::string  whatShift = what + " bytesShifted=" + std::to_string(shifted);
+                std::vector<uint16_t> sh1(2 * n), sh2(2 * n);
+
+                std::vector<uint8_t> in24 = pack(values(fill, n * stride, 24), 24, 3);
+                gScalar->mix24(in24.data(), stride, u1.data(), v1.data(), n, MIX_BITS, mixres, sh1.data(), shifted);
+                gVariant->mix24(in24.data(), stride, u2.data(), v2.data(), n, MIX_BITS, mixres, sh2.data(), shifted);
+                check(u1, u2, whatShift + " mix24 u");
+                check(v1, v2, whatShift + " mix24 v");
+                check(sh1, sh2, whatShift + " mix24 shift");
+
+                // the encoder always shifts the mixed 32-bit samples, their sum would overflow
+                if (mixres != 0 && shifted == 0) {
+                    continue;
+                }
+
+                std::vector<int32_t> in32 = values(fill, n * stride, 32);
+                gScalar->mix32(in32.data(), stride, u1.data(), v1.data(), n, MIX_BITS, mixres, sh1.data(), shifted);
+                gVariant->mix32(in32.data(), stride, u2.data(), v2.data(), n, MIX_BITS, mixres, sh2.data(), shifted);
+                check(u1, u2, whatShift + " mix32 u");
+                check(v1, v2, whatShift + " mix32 v");
+                check(sh1, sh2, whatShift + " mix32 shift");
+            }
+        }
+    }
+}
+
+/************************************************
+ * stereoStats, copy20ToPredictor, copy24ToPredictor
+ ************************************************/
+static void testCopy(int32_t n, Fill fill)
+{
+    const std::string what = name("copy", n, fill);
+
+    std::vector<int32_t> u = values(fill, n, 25), v = values(fill, n, 25);
+    std::vector<int64_t> st1(3), st2(3);
+    gScalar->stereoStats(u.data(), v.data(), n, st1.data());
+    gVariant->stereoStats(u.data(), v.data(), n, st2.data());
+    check(st1, st2, what + " stereoStats");
+
+    for (uint32_t stride : { 1u, 2u, 6u }) {
+        std::vector<int32_t> out1(n), out2(n);
+
+        std::vector<uint8_t> in20 = pack(values(fill, n * stride, 20), 20, 3);
+        gScalar->copy20ToPredictor(in20.data(), stride, out1.data(), n);
+        gVariant->copy20ToPredictor(in20.data(), stride, out2.data(), n);
+        check(out1, out2, what + " copy20ToPredictor stride=" + std::to_string(stride));
+
+        std::vector<uint8_t> in24 = pack(values(fill, n * stride, 24), 24, 3);
+        gScalar->copy24ToPredictor(in24.data(), stride, out1.data(), n);
+        gVariant->copy24ToPredictor(in24.data(), stride, out2.data(), n);
+        check(out1, out2, what + " copy24ToPredictor stride=" + std::to_string(stride));
+    }
+}
+
+/************************************************
+ * swapBytes, uint8ToInt16, floatToInt, doubleToInt
+ ************************************************/
+static void testConvert(int32_t n, Fill fill)
+{
+    const std::string what = name("convert", n, fill);
+
+    for (uint32_t sampleBytes : { 2u, 3u, 4u, 8u }) {
+        std::vector<uint8_t> d1(n * sampleBytes);
+        for (uint8_t &b : d1) {
+            b = uint8_t(value(fill, 0, 255));
+        }
+        std::vector<uint8_t> d2 = d1;
+        gScalar->swapBytes(d1.data(), n, sampleBytes);
+        gVariant->swapBytes(d2.data(), n, sampleBytes);
+        check(d1, d2, what + " swapBytes sampleBytes=" + std::to_string(sampleBytes));
+    }
+
+    std::vector<uint8_t> in8(n);
+    for (uint8_t &b : in8) {
+        b = uint8_t(value(fill, 0, 255));
+    }
+    std::vector<int16_t> out16a(n), out16b(n);
+    gScalar->uint8ToInt16(in8.data(), out16a.data(), n);
+    gVariant->uint8ToInt16(in8.data(), out16b.data(), n);
+    check(out16a, out16b, what + " uint8ToInt16");
+
+    // the exact integers, the values between them, out of range ones, infinities and NaN
+    static const double SPECIAL[] = { 0.0, -0.0, 1.0, -1.0, 0.5, -0.5, 1.0000001, -1.0000001, 2.0, -2.0, 1e30, -1e30,
+                                      std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity(),
+                                      std::numeric_limits<double>::quiet_NaN(), std::numeric_limits<double>::denorm_min() };
+
+    for (uint32_t bits : { 16u, 20u, 24u }) {
+        const double        scale = double(1u << (bits - 1));
+        std::vector<double> in64(n);
+        for (double &x : in64) {
+            switch (fill) {
+                case Fill::FullScale: x = SPECIAL[gRandom() % (sizeof(SPECIAL) / sizeof(SPECIAL[0]))]; break;
+                case Fill::Small:     x = (value(fill, -4, 4) + 0.5 * value(fill, -1, 1)) / scale; break;
+                default:              x = std::uniform_real_distribution<double>(-1.1, 1.1)(gRandom); break;
+            }
+        }
+        std::vector<float> in32(in64.begin(), in64.end());
+
+        std::vector<int32_t> out1(n), out2(n);
+        int32_t              r1 = gScalar->floatToInt(in32.data(), out1.data(), n, bits);
+        int32_t              r2 = gVariant->floatToInt(in32.data(), out2.data(), n, bits);
+        check(out1, out2, what + " floatToInt bits=" + std::to_string(bits));
+        check(r1, r2, what + " floatToInt bits=" + std::to_string(bits));
+
+        r1 = gScalar->doubleToInt(in64.data(), out1.data(), n, bits);
+        r2 = gVariant->doubleToInt(in64.data(), out2.data(), n, bits);
+        check(out1, out2, what + " doubleToInt bits=" + std::to_string(bits));
+        check(r1, r2, what + " doubleToInt bits=" + std::to_string(bits));
+    }
+}
+
+/************************************************
+ * pc_block, diff_autocorr and dyn_comp over the channel
+ * depths and predictor orders the encoder uses
+ ************************************************/
+static void testPredictor(int32_t n, Fill fill)
+{
+    static const int32_t  MAX_COEFS         = 32;
+    static const uint32_t DENSHIFT          = 9;
+    static const int32_t  NUM_ACTIVE[]      = { 0, 1, 2, 4, 8, 12, 16, 31 };
+    static const uint32_t CHAN_BITS[]       = { 16, 17, 20, 21, 24, 25, 31 };
+    static const int32_t  MAX_AUTOCORR_LAGS = 8;
+
+    for (uint32_t chanbits : CHAN_BITS) {
+        const std::string what = name("predictor", n, fill) + " chanbits=" + std::to_string(chanbits);
+
+        std::vector<int32_t> in = values(fill, n, chanbits);
+
+        std::vector<int64_t> r1(MAX_AUTOCORR_LAGS + 1), r2(MAX_AUTOCORR_LAGS + 1);
+        gScalar->diff_autocorr(in.data(), n, r1.data(), MAX_AUTOCORR_LAGS, chanbits);
+        gVariant->diff_autocorr(in.data(), n, r2.data(), MAX_AUTOCORR_LAGS, chanbits);
+        check(r1, r2, what + " diff_autocorr");
+
+        for (int32_t numactive : NUM_ACTIVE) {
+            if (numactive >= n) {
+                continue;
+            }
+
+            const std::string whatOrder = what + " numactive=" + std::to_string(numactive);
+
+            // the coefs adapt while predicting, every variant gets its own copy
+            std::vector<int16_t> coefs1(MAX_COEFS);
+            for (int16_t &c : coefs1) {
+                c = int16_t(value(fill == Fill::FullScale ? Fill::Random : fill, -2048, 2048));
+            }
+            std::vector<int16_t> coefs2 = coefs1;
+
+            std::vector<int32_t> pc1(n), pc2(n);
+            gScalar->pc_block(in.data(), pc1.data(), n, coefs1.data(), numactive, chanbits, DENSHIFT);
+            gVariant->pc_block(in.data(), pc2.data(), n, coefs2.data(), numactive, chanbits, DENSHIFT);
+            check(pc1, pc2, whatOrder + " pc_block");
+            check(coefs1, coefs2, whatOrder + " pc_block coefs");
+        }
+
+        // the residuals of chanbits bits, with the escapes of the large ones
+        std::vector<uint8_t> out1(size_t(n) * 8 + 64), out2(out1.size());
+        BitBuffer            bits1, bits2;
+        BitBufferInit(&bits1, out1.data(), out1.size());
+        BitBufferInit(&bits2, out2.data(), out2.size());
+
+        AGParamRec params1, params2;
+        set_ag_params(&params1, MB0, PB0, KB0, n, n, MAX_RUN_DEFAULT);
+        set_ag_params(&params2, MB0, PB0, KB0, n, n, MAX_RUN_DEFAULT);
+
+        std::vector<int32_t> pc1 = values(fill, n, chanbits);
+        std::vector<int32_t> pc2 = pc1;
+        uint32_t             numBits1 = 0, numBits2 = 0;
+        int32_t              s1       = gScalar->dyn_comp(&params1, pc1.data(), &bits1, n, chanbits, &numBits1);
+        int32_t              s2       = gVariant->dyn_comp(&params2, pc2.data(), &bits2, n, chanbits, &numBits2);
+        check(s1, s2, what + " dyn_comp status");
+        check(numBits1, numBits2, what + " dyn_comp bits");
+        check(out1, out2, what + " dyn_comp output");
+    }
+}
+
+int main()
+{
+    const ALACKernels *list[16];
+    int32_t            count = ALACListKernels(list, 16);
+
+    gScalar = ALACFindKernels("scalar");
+    if (!gScalar || count < 1 || list[0] != gScalar) {
+        fprintf(stderr, "FAIL the scalar kernels are not the first variant\n");
+        return 1;
+    }
+
+    if (ALACGetKernels() != list[count - 1]) {
+        fprintf(stderr, "FAIL ALACGetKernels() is not the fastest supported variant\n");
+        return 1;
+    }
+
+    for (int32_t i = 0; i < count; ++i) {
+        gVariant = list[i];
+        printf("%s\n", gVariant->name);
+
+        // the same random buffers for every variant
+        gRandom.seed(1);
+        for (int32_t n : LENGTHS) {
+            for (Fill fill : FILLS) {
+                testMix(n, fill);
+                testCopy(n, fill);
+                testConvert(n, fill);
+                testPredictor(n, fill);
+            }
+        }
+    }
+
+    if (gFailures) {
+        fprintf(stderr, "%d checks failed\n", gFailures);
+        return 1;
+    }
+    return 0;
+}
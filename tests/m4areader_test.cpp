@@ -0,0 +1,268 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)MIT
+ *
+ * Flacon - audio File Encoder
+ * https://github.com/flacon/flacon
+ *
+ * Copyright: 2022
+ *   Alexander Sokoloff <sokoloff.a@gmail.com>
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Alexander Sokoloff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+// Decodes the m4a files of alacenc with M4aReader and AlacDecodeStream, the reader of the m4a input:
+// m4areader_test <alacenc>. The files are encoded from a generated signal and must decode to it
+//   - by one thread and by several,
+//   - from a position in the middle of the stream,
+//   - after alacenc has encoded them again from the m4a,
+//   - with the sample tables rewritten: a co64 atom, several chunks in stsc, a duration per packet
+//     in stts and, with more than 2 channels, the size of the alac entry in stsd without the chan
+//     atom after it, the reader takes the entry to the end of stsd.
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "m4areader.h"
+#include "testutils.h"
+
+static const uint32_t NUM_THREADS = 4;
+
+// Compares the decoded PCM with the expected one from the byte offset on
+static void checkPcmAt(const std::string &name, const std::vector<uint8_t> &decoded, const std::vector<uint8_t> &expected, size_t offset)
+{
+    if (!check(offset + decoded.size() <= expected.size(), "%s: %zu bytes decoded at %zu of %zu", name.c_str(), decoded.size(), offset, expected.size())) {
+        return;
+    }
+
+    for (size_t i = 0; i < decoded.size(); ++i) {
+        if (!check(decoded[i] == expected[offset + i], "%s: the decoded byte %zu is %u instead of %u", name.c_str(), offset + i, decoded[i], expected[offset + i])) {
+            return;
+        }
+    }
+}
+
+// Compares the whole decoded PCM with the expected one
+static void checkPcm(const std::string &name, const std::vector<uint8_t> &decoded, const std::vector<uint8_t> &expected)
+{
+    if (check(decoded.size() == expected.size(), "%s: %zu bytes decoded instead of %zu", name.c_str(), decoded.size(), expected.size())) {
+        checkPcmAt(name, decoded, expected, 0);
+    }
+}
+
+static void putBE32(std::vector<uint8_t> &out, uint32_t value)
+{
+    out.insert(out.end(), { uint8_t(value >> 24), uint8_t(value >> 16), uint8_t(value >> 8), uint8_t(value) });
+}
+
+static void putBE64(std::vector<uint8_t> &out, uint64_t value)
+{
+    putBE32(out, uint32_t(value >> 32));
+    putBE32(out, uint32_t(value));
+}
+
+// The atom of the type with the data, version and flags included
+static std::vector<uint8_t> makeBox(const std::string &type, const std::vector<uint8_t> &data)
+{
+    std::vector<uint8_t> res;
+    putBE32(res, data.size() + 8);
+    res.insert(res.end(), type.begin(), type.end());
+    res.insert(res.end(), data.begin(), data.end());
+    return res;
+}
+
+// The atom again, with the atoms of the types in replace put in place of the ones of the track
+static std::vector<uint8_t> rebuildBox(const std::vector<uint8_t> &file, const Box &box, const std::map<std::string, std::vector<uint8_t>> &replace)
+{
+    static const char *const CONTAINERS[] = { "moov", "trak", "mdia", "minf", "stbl" };
+
+    for (const char *container : CONTAINERS) {
+        if (box.type == container) {
+            std::vector<uint8_t> data;
+            for (const Box &child : childBoxes(file, box.dataPos, box.pos + box.size)) {
+                std::vector<uint8_t> atom = rebuildBox(file, child, replace);
+                data.insert(data.end(), atom.begin(), atom.end());
+            }
+            return makeBox(box.type, data);
+        }
+    }
+
+    auto it = replace.find(box.type);
+    if (it != replace.end()) {
+        return it->second;
+    }
+    return std::vector<uint8_t>(file.begin() + box.pos, file.begin() + box.pos + box.size);
+}
+
+// The stsd atom of the file with the size of its alac entry cut before the chan atom, as alacenc
+// and other writers give it
+static std::vector<uint8_t> cutStsdEntry(const std::vector<uint8_t> &file)
+{
+    Box box = findBox(file, Box { "", 0, 0, file.size() }, "moov");
+    for (const char *type : { "trak", "mdia", "minf", "stbl", "stsd" }) {
+        box = findBox(file, box, type);
+    }
+
+    std::vector<uint8_t> res(file.begin() + box.pos, file.begin() + box.pos + box.size);
+
+    // the version, the flags and the number of entries come before the entry, the size and the
+    // type of the chan atom before its name
+    const size_t entryPos = box.dataPos - box.pos + 8;
+    for (size_t i = entryPos + 8; i + 4 <= res.size(); ++i) {
+        if (memcmp(&res[i], "chan", 4) == 0) {
+            const uint32_t size = uint32_t(i - 4 - entryPos);
+            res[entryPos]       = uint8_t(size >> 24);
+            res[entryPos + 1]   = uint8_t(size >> 16);
+            res[entryPos + 2]   = uint8_t(size >> 8);
+            res[entryPos + 3]   = uint8_t(size);
+            break;
+        }
+    }
+    return res;
+}
+
+// The m4a file with the packets in chunks of 1, 2, 3, 1, 2, 3 ... packets in a co64 atom and a
+// duration for every packet in stts; the packets stay where they are
+static std::vector<uint8_t> rewriteSampleTables(const std::vector<uint8_t> &file, const std::vector<M4aReader::Packet> &packets)
+{
+    std::vector<uint8_t> stts = { 0, 0, 0, 0 };
+    putBE32(stts, packets.size());
+    for (const M4aReader::Packet &packet : packets) {
+        putBE32(stts, 1);
+        putBE32(stts, packet.numFrames);
+    }
+
+    std::vector<uint64_t> chunkOffsets;
+    std::vector<uint8_t>  stscEntries;
+    uint32_t              numEntries = 0;
+    uint32_t              lastCount  = 0;
+    for (size_t i = 0; i < packets.size(); i += lastCount) {
+        uint32_t count = std::min<size_t>(chunkOffsets.size() % 3 + 1, packets.size() - i);
+        if (count != lastCount) {
+            putBE32(stscEntries, chunkOffsets.size() + 1);
+            putBE32(stscEntries, count);
+            putBE32(stscEntries, 1);
+            numEntries++;
+        }
+        chunkOffsets.push_back(packets[i].offset);
+        lastCount = count;
+    }
+
+    std::vector<uint8_t> stsc = { 0, 0, 0, 0 };
+    putBE32(stsc, numEntries);
+    stsc.insert(stsc.end(), stscEntries.begin(), stscEntries.end());
+
+    std::vector<uint8_t> co64 = { 0, 0, 0, 0 };
+    putBE32(co64, chunkOffsets.size());
+    for (uint64_t offset : chunkOffsets) {
+        putBE64(co64, offset);
+    }
+
+    std::map<std::string, std::vector<uint8_t>> replace = {
+        { "stts", makeBox("stts", stts) },
+        { "stsc", makeBox("stsc", stsc) },
+        { "stco", makeBox("co64", co64) },
+        { "stsd", cutStsdEntry(file) },
+    };
+
+    std::vector<uint8_t> res;
+    for (const Box &box : childBoxes(file, 0, file.size())) {
+        std::vector<uint8_t> atom = box.type == "moov" ? rebuildBox(file, box, replace) : std::vector<uint8_t>(file.begin() + box.pos, file.begin() + box.pos + box.size);
+        res.insert(res.end(), atom.begin(), atom.end());
+    }
+    return res;
+}
+
+static void testChannels(uint32_t numChannels)
+{
+    const std::string          name      = "m4areader-" + std::to_string(numChannels);
+    const uint32_t             numFrames = 4096 * 20 + 1000;
+    const std::vector<uint8_t> pcm       = testSignal(16, numChannels, numFrames, numChannels);
+    const uint32_t             frameBytes = 2 * numChannels;
+
+    writeFile(name + ".wav", wavFile(44100, 16, numChannels, pcm));
+    std::string err;
+    int         status = runAlacenc("-q -1 " + quote(name + ".wav") + " " + quote(name + ".m4a"), &err);
+    if (!check(status == 0, "%s: alacenc exited with %d: %s", name.c_str(), status, err.c_str())) {
+        return;
+    }
+
+    checkPcm(name + " by 1 thread", decodeM4a(name + ".m4a", 1), pcm);
+    checkPcm(name + " by " + std::to_string(NUM_THREADS) + " threads", decodeM4a(name + ".m4a", NUM_THREADS), pcm);
+
+    const std::vector<uint8_t> file = readFile(name + ".m4a");
+
+    // a position in the middle of a packet
+    std::ifstream                    stream(name + ".m4a", std::ios::binary);
+    std::shared_ptr<const M4aReader> reader = std::make_shared<M4aReader>(&stream);
+    {
+        AlacDecodeStream decoder(std::make_shared<std::ifstream>(name + ".m4a", std::ios::binary), reader, NUM_THREADS);
+        const size_t     pos = size_t(numFrames / 2 + 123) * frameBytes;
+
+        std::vector<uint8_t> decoded(4096 * 3 * frameBytes);
+        decoder.seekg(pos);
+        decoder.read((char *)decoded.data(), decoded.size());
+        check(size_t(decoder.gcount()) == decoded.size(), "%s: %zu bytes read at %zu", name.c_str(), size_t(decoder.gcount()), pos);
+        checkPcmAt(name + " at " + std::to_string(pos), decoded, pcm, pos);
+
+        // and back to the start
+        decoded.resize(1000 * frameBytes);
+        decoder.seekg(0);
+        decoder.read((char *)decoded.data(), decoded.size());
+        checkPcmAt(name + " at 0", decoded, pcm, 0);
+    }
+
+    // the m4a input of alacenc
+    status = runAlacenc("-q -1 " + quote(name + ".m4a") + " " + quote(name + "-again.m4a"), &err);
+    if (check(status == 0, "%s: alacenc exited with %d on the m4a: %s", name.c_str(), status, err.c_str())) {
+        checkPcm(name + " encoded again", decodeM4a(name + "-again.m4a"), pcm);
+    }
+
+    writeFile(name + "-co64.m4a", rewriteSampleTables(file, reader->packets()));
+    checkPcm(name + " with co64 by 1 thread", decodeM4a(name + "-co64.m4a", 1), pcm);
+    checkPcm(name + " with co64 by " + std::to_string(NUM_THREADS) + " threads", decodeM4a(name + "-co64.m4a", NUM_THREADS), pcm);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <alacenc>\n", argv[0]);
+        return 2;
+    }
+    gAlacenc = argv[1];
+
+    for (uint32_t numChannels : { 2, 6 }) {
+        try {
+            testChannels(numChannels);
+        }
+        catch (const std::exception &e) {
+            check(false, "%u channels: %s", numChannels, e.what());
+        }
+    }
+
+    return gFailures ? 1 : 0;
+}
@@ -0,0 +1,204 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)MIT
+ *
+ * Flacon - audio File Encoder
+ * https://github.com/flacon/flacon
+ *
+ * Copyright: 2022
+ *   Alexander Sokoloff <sokoloff.a@gmail.com>
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Alexander Sokoloff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+// Encodes generated signals with the vendored ALACEncoder, decodes every packet with the vendored
+// ALACDecoder and compares the result with the input: every bit depth, mono, stereo and
+// multichannel, the frame sizes from the shortest to the longest one, the compression levels and
+// the adaptive packet lengths, and a partial last frame every time
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include "vendor/alac/codec/ALACEncoder.h"
+#include "vendor/alac/codec/ALACDecoder.h"
+#include "vendor/alac/codec/ALACBitUtilities.h"
+
+static const uint32_t BIT_DEPTHS[]  = { 16, 20, 24, 32 };
+static const uint32_t CHANNELS[]    = { 1, 2, 6 };
+static const uint32_t FRAME_SIZES[] = { kALACMinFrameSize, 33, 256, 1000, 1152, kALACDefaultFrameSize, 4097, kALACMaxFrameSize };
+static const int32_t  LEVELS[]      = { kALACMinCompressionLevel, 1, 5, kALACMaxCompressionLevel };
+
+// the bit reader of the decoder can look a few bytes past the end of a packet
+static const uint32_t PACKET_PADDING = 8;
+
+// Silence, DC, a tone, noise and full-scale square waves in turns, the turns are shorter than the
+// longer frames, so SplitFrame() cuts them where the signal changes
+static std::vector<uint8_t> generate(uint32_t bitDepth, uint32_t numChannels, uint32_t numFrames)
+{
+    const uint32_t sampleBytes = (bitDepth == 20) ? 3 : bitDepth / 8;
+    const int64_t  hi          = (int64_t(1) << (bitDepth - 1)) - 1;
+
+    std::mt19937         random(bitDepth * 100 + numChannels);
+    std::vector<uint8_t> res(size_t(numFrames) * numChannels * sampleBytes);
+    uint8_t             *out = res.data();
+
+    for (uint32_t i = 0; i < numFrames; ++i) {
+        for (uint32_t c = 0; c < numChannels; ++c) {
+            int64_t v = 0;
+            switch ((i / 1500 + c) % 5) {
+                case 0: v = 0; break;
+                case 1: v = hi / 3; break;
+                case 2: v = int64_t(hi * 0.8 * std::sin(i * 0.01 * (c + 1))); break;
+                case 3: v = std::uniform_int_distribution<int64_t>(-hi - 1, hi)(random); break;
+                case 4: v = ((i / 16) & 1) ? hi : -hi - 1; break;
+            }
+
+            // left-justified in the container, e.g. 20 bits in 3 bytes
+            uint32_t u = uint32_t(v) << (sampleBytes * 8 - bitDepth);
+            for (uint32_t b = 0; b < sampleBytes; ++b) {
+                *out++ = uint8_t(u >> (8 * b));
+            }
+        }
+    }
+    return res;
+}
+
+static bool roundTrip(uint32_t bitDepth, uint32_t numChannels, uint32_t frameSize, int32_t level, bool adaptive)
+{
+    const std::string name = std::to_string(bitDepth) + "-bit " + std::to_string(numChannels) + "ch frame=" + std::to_string(frameSize) + " level=" + std::to_string(level) + (adaptive ? " adaptive" : "");
+
+    const uint32_t sampleBytes = (bitDepth == 20) ? 3 : bitDepth / 8;
+    const uint32_t frameBytes  = sampleBytes * numChannels;
+
+    AudioFormatDescription inFormat {};
+    inFormat.mFormatID         = kALACFormatLinearPCM;
+    inFormat.mSampleRate       = 44100;
+    inFormat.mFormatFlags      = kALACFormatFlagIsSignedInteger | kALACFormatFlagIsPacked;
+    inFormat.mBytesPerPacket   = frameBytes;
+    inFormat.mFramesPerPacket  = 1;
+    inFormat.mBytesPerFrame    = frameBytes;
+    inFormat.mChannelsPerFrame = numChannels;
+    inFormat.mBitsPerChannel   = sampleBytes * 8;
+
+    // the source format flags 1 ... 4 are 16, 20, 24 and 32 bits
+    AudioFormatDescription outFormat {};
+    outFormat.mFormatID         = kALACFormatAppleLossless;
+    outFormat.mSampleRate       = 44100;
+    outFormat.mFormatFlags      = (bitDepth == 16) ? 1 : (bitDepth == 20) ? 2 : (bitDepth == 24) ? 3 : 4;
+    outFormat.mFramesPerPacket  = frameSize;
+    outFormat.mChannelsPerFrame = numChannels;
+
+    ALACEncoder encoder;
+    encoder.SetFrameSize(frameSize);
+    encoder.InitializeEncoder(outFormat);
+    encoder.SetCompressionLevel(level);
+
+    std::vector<uint8_t> cookie(encoder.GetMagicCookieSize(numChannels));
+    uint32_t             cookieSize = cookie.size();
+    encoder.GetMagicCookie(cookie.data(), &cookieSize);
+
+    ALACDecoder decoder;
+    if (decoder.Init(cookie.data(), cookieSize) != 0) {
+        fprintf(stderr, "FAIL %s: the decoder rejects the magic cookie\n", name.c_str());
+        return false;
+    }
+
+    // two full frames and a partial one
+    const uint32_t             numFrames = 2 * frameSize + frameSize / 3 + 1;
+    const std::vector<uint8_t> input     = generate(bitDepth, numChannels, numFrames);
+
+    std::vector<uint8_t> frame(size_t(frameSize) * frameBytes);
+    std::vector<uint8_t> packet(encoder.maxOutputBytes() + PACKET_PADDING);
+    std::vector<uint8_t> decoded(size_t(frameSize) * frameBytes);
+
+    for (uint32_t pos = 0; pos < numFrames; pos += frameSize) {
+        const uint32_t count = std::min(frameSize, numFrames - pos);
+        memcpy(frame.data(), input.data() + size_t(pos) * frameBytes, size_t(count) * frameBytes);
+
+        uint32_t lengths[kALACMaxFrameSplits] = { count };
+        uint32_t numPackets                   = adaptive ? encoder.SplitFrame(inFormat, frame.data(), count, lengths) : 1;
+
+        uint32_t done = 0;
+        for (uint32_t p = 0; p < numPackets; ++p) {
+            const uint32_t first = pos + done;
+
+            int32_t size = lengths[p] * frameBytes;
+            if (encoder.Encode(inFormat, outFormat, frame.data() + size_t(done) * frameBytes, packet.data(), &size) != 0) {
+                fprintf(stderr, "FAIL %s: can't encode the packet at %u\n", name.c_str(), first);
+                return false;
+            }
+
+            BitBuffer bits;
+            BitBufferInit(&bits, packet.data(), size);
+
+            uint32_t decodedFrames = 0;
+            if (decoder.Decode(&bits, decoded.data(), frameSize, numChannels, &decodedFrames) != 0) {
+                fprintf(stderr, "FAIL %s: can't decode the packet at %u\n", name.c_str(), first);
+                return false;
+            }
+
+            if (decodedFrames != lengths[p]) {
+                fprintf(stderr, "FAIL %s: the packet at %u has %u frames instead of %u\n", name.c_str(), first, decodedFrames, lengths[p]);
+                return false;
+            }
+
+            if (memcmp(decoded.data(), input.data() + size_t(first) * frameBytes, size_t(decodedFrames) * frameBytes) != 0) {
+                fprintf(stderr, "FAIL %s: the packet at %u differs from the input\n", name.c_str(), first);
+                return false;
+            }
+            done += lengths[p];
+        }
+
+        if (done != count) {
+            fprintf(stderr, "FAIL %s: the packets at %u have %u frames instead of %u\n", name.c_str(), pos, done, count);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main()
+{
+    int failures = 0;
+    int total    = 0;
+
+    for (uint32_t bitDepth : BIT_DEPTHS) {
+        for (uint32_t numChannels : CHANNELS) {
+            for (uint32_t frameSize : FRAME_SIZES) {
+                for (int32_t level : LEVELS) {
+                    for (bool adaptive : { false, true }) {
+                        failures += !roundTrip(bitDepth, numChannels, frameSize, level, adaptive);
+                        total++;
+                    }
+                }
+            }
+        }
+    }
+
+    printf("%d of %d round trips passed\n", total - failures, total);
+    return failures ? 1 : 0;
+}
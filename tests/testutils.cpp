@@ -0,0 +1,264 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)MIT
+ *
+ * Flacon - audio File Encoder
+ * https://github.com/flacon/flacon
+ *
+ * Copyright: 2022
+ *   Alexander Sokoloff <sokoloff.a@gmail.com>
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Alexander Sokoloff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#include "testutils.h"
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "m4areader.h"
+#include "vendor/alac/codec/ALACDecoder.h"
+#include "vendor/alac/codec/ALACBitUtilities.h"
+
+std::string gAlacenc;
+int         gFailures = 0;
+
+// the bit reader of the decoder can look a few bytes past the end of a packet
+static const uint32_t PACKET_PADDING = 8;
+
+bool check(bool ok, const char *format, ...)
+{
+    if (!ok) {
+        va_list args;
+        va_start(args, format);
+        fprintf(stderr, "FAIL ");
+        vfprintf(stderr, format, args);
+        fprintf(stderr, "\n");
+        va_end(args);
+        gFailures++;
+    }
+    return ok;
+}
+
+std::vector<uint8_t> readFile(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+void writeFile(const std::string &path, const std::vector<uint8_t> &data)
+{
+    std::ofstream file(path, std::ios::binary);
+    file.write((const char *)data.data(), data.size());
+}
+
+std::string quote(const std::string &path)
+{
+    std::string res = "'";
+    for (char c : path) {
+        res += (c == '\'') ? std::string("'\\''") : std::string(1, c);
+    }
+    return res + "'";
+}
+
+int runAlacenc(const std::string &args, std::string *err)
+{
+    const std::string errFile = "alacenc-" + std::to_string(getpid()) + ".err";
+
+    int status = std::system((quote(gAlacenc) + " " + args + " 2>" + errFile).c_str());
+    if (err) {
+        std::vector<uint8_t> text = readFile(errFile);
+        err->assign(text.begin(), text.end());
+    }
+    remove(errFile.c_str());
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+std::vector<uint8_t> testSignal(uint32_t bits, uint32_t numChannels, uint32_t numFrames, uint32_t seed)
+{
+    const uint32_t sampleBytes = (bits + 7) / 8;
+    const int64_t  hi          = (int64_t(1) << (bits - 1)) - 1;
+
+    std::mt19937         random(seed);
+    std::vector<uint8_t> res(size_t(numFrames) * numChannels * sampleBytes);
+    uint8_t             *out = res.data();
+
+    for (uint32_t i = 0; i < numFrames; ++i) {
+        for (uint32_t c = 0; c < numChannels; ++c) {
+            int64_t v = 0;
+            switch ((i / 3000 + c + seed) % 4) {
+                case 0: v = int64_t(hi * 0.5 * std::sin(i * 0.003 * (c + 1))) + std::uniform_int_distribution<int64_t>(-64, 64)(random); break;
+                case 1: v = std::uniform_int_distribution<int64_t>(-hi - 1, hi)(random); break;
+                case 2: v = 0; break;
+                case 3: v = ((i / 64) & 1) ? hi : -hi - 1; break;
+            }
+            v = std::min(std::max(v, -hi - 1), hi);
+
+            // left-justified in the container, e.g. 20 bits in 3 bytes
+            uint32_t u = uint32_t(v) << (sampleBytes * 8 - bits);
+            for (uint32_t b = 0; b < sampleBytes; ++b) {
+                *out++ = uint8_t(u >> (8 * b));
+            }
+        }
+    }
+    return res;
+}
+
+static void putLE(std::vector<uint8_t> &out, uint64_t value, uint32_t bytes)
+{
+    for (uint32_t b = 0; b < bytes; ++b) {
+        out.push_back(uint8_t(value >> (8 * b)));
+    }
+}
+
+std::vector<uint8_t> wavFile(uint32_t sampleRate, uint32_t bits, uint32_t numChannels, const std::vector<uint8_t> &pcm)
+{
+    const uint32_t blockAlign = (bits + 7) / 8 * numChannels;
+    const bool     extensible = numChannels > 2;
+
+    std::vector<uint8_t> fmt;
+    putLE(fmt, extensible ? 0xFFFE : 1, 2);
+    putLE(fmt, numChannels, 2);
+    putLE(fmt, sampleRate, 4);
+    putLE(fmt, sampleRate * blockAlign, 4);
+    putLE(fmt, blockAlign, 2);
+    putLE(fmt, (bits + 7) / 8 * 8, 2);
+    if (extensible) {
+        static const uint8_t PCM_GUID[16] = { 1, 0, 0, 0, 0, 0, 0x10, 0, 0x80, 0, 0, 0xAA, 0, 0x38, 0x9B, 0x71 };
+        putLE(fmt, 22, 2);
+        putLE(fmt, bits, 2);
+        putLE(fmt, (1u << numChannels) - 1, 4);
+        fmt.insert(fmt.end(), PCM_GUID, PCM_GUID + 16);
+    }
+
+    std::vector<uint8_t> res = { 'R', 'I', 'F', 'F' };
+    putLE(res, 4 + 8 + fmt.size() + 8 + pcm.size(), 4);
+    res.insert(res.end(), { 'W', 'A', 'V', 'E', 'f', 'm', 't', ' ' });
+    putLE(res, fmt.size(), 4);
+    res.insert(res.end(), fmt.begin(), fmt.end());
+    res.insert(res.end(), { 'd', 'a', 't', 'a' });
+    putLE(res, pcm.size(), 4);
+    res.insert(res.end(), pcm.begin(), pcm.end());
+    return res;
+}
+
+std::vector<uint8_t> decodeM4a(const std::string &path, uint32_t numThreads, uint32_t *bitDepth)
+{
+    std::ifstream                    file(path, std::ios::binary);
+    std::shared_ptr<const M4aReader> reader = std::make_shared<M4aReader>(&file);
+    if (bitDepth) {
+        *bitDepth = reader->bitDepth();
+    }
+
+    AlacDecodeStream stream(std::make_shared<std::ifstream>(path, std::ios::binary), reader, numThreads);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+}
+
+uint32_t readBE16(const uint8_t *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+uint32_t readBE32(const uint8_t *p)
+{
+    return (uint32_t(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+uint64_t readBE64(const uint8_t *p)
+{
+    return (uint64_t(readBE32(p)) << 32) | readBE32(p + 4);
+}
+
+std::vector<Box> childBoxes(const std::vector<uint8_t> &file, uint64_t begin, uint64_t end)
+{
+    std::vector<Box> res;
+    for (uint64_t pos = begin; pos < end;) {
+        if (end - pos < 8) {
+            return {};
+        }
+
+        Box box;
+        box.pos     = pos;
+        box.size    = readBE32(&file[pos]);
+        box.type    = std::string((const char *)&file[pos + 4], 4);
+        box.dataPos = pos + 8;
+        if (box.size == 1 && end - pos >= 16) {
+            box.size    = readBE64(&file[pos + 8]);
+            box.dataPos = pos + 16;
+        }
+
+        if (box.size < box.dataPos - pos || box.size > end - pos) {
+            return {};
+        }
+        res.push_back(box);
+        pos += box.size;
+    }
+    return res;
+}
+
+Box findBox(const std::vector<uint8_t> &file, const Box &parent, const std::string &type)
+{
+    for (const Box &box : childBoxes(file, parent.dataPos, parent.pos + parent.size)) {
+        if (box.type == type) {
+            return box;
+        }
+    }
+    return Box();
+}
+
+std::vector<uint8_t> decodePackets(const std::vector<uint8_t> &cookie, const uint8_t *data, const std::vector<uint32_t> &packetSizes, const std::vector<uint32_t> &packetFrames)
+{
+    ALACDecoder          decoder;
+    std::vector<uint8_t> config(cookie);
+    if (decoder.Init(config.data(), config.size()) != 0) {
+        return {};
+    }
+
+    const uint32_t numChannels = decoder.mConfig.numChannels;
+    const uint32_t frameBytes  = (decoder.mConfig.bitDepth == 20 ? 3 : decoder.mConfig.bitDepth / 8) * numChannels;
+
+    std::vector<uint8_t> res;
+    std::vector<uint8_t> packet;
+    std::vector<uint8_t> decoded(size_t(decoder.mConfig.frameLength) * frameBytes);
+    for (size_t i = 0; i < packetSizes.size(); ++i) {
+        packet.assign(data, data + packetSizes[i]);
+        packet.resize(packetSizes[i] + PACKET_PADDING);
+        data += packetSizes[i];
+
+        BitBuffer bits;
+        BitBufferInit(&bits, packet.data(), packetSizes[i]);
+
+        uint32_t numFrames = 0;
+        if (decoder.Decode(&bits, decoded.data(), decoder.mConfig.frameLength, numChannels, &numFrames) != 0 || numFrames != packetFrames[i]) {
+            return {};
+        }
+        res.insert(res.end(), decoded.begin(), decoded.begin() + size_t(numFrames) * frameBytes);
+    }
+    return res;
+}
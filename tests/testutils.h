@@ -0,0 +1,96 @@
+/* BEGIN_COMMON_COPYRIGHT_HEADER
+ * (c)MIT
+ *
+ * Flacon - audio File Encoder
+ * https://github.com/flacon/flacon
+ *
+ * Copyright: 2022
+ *   Alexander Sokoloff <sokoloff.a@gmail.com>
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Alexander Sokoloff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * END_COMMON_COPYRIGHT_HEADER */
+
+#ifndef TESTUTILS_H
+#define TESTUTILS_H
+
+// The helpers of the tests that run alacenc: the files, the generated input and the decoding and
+// parsing of the output
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// the alacenc binary the tests run, the first argument of every test
+extern std::string gAlacenc;
+
+// the failures check() has reported
+extern int gFailures;
+
+// Counts and prints a failure if ok is false, returns ok
+bool check(bool ok, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+std::vector<uint8_t> readFile(const std::string &path);
+void                 writeFile(const std::string &path, const std::vector<uint8_t> &data);
+
+// Runs "alacenc args" with the shell, returns the exit status and the standard error in err
+int runAlacenc(const std::string &args, std::string *err = nullptr);
+
+// The path quoted for the shell
+std::string quote(const std::string &path);
+
+// Little-endian PCM of bits-bit samples in their containers, 20-bit samples are left-justified in
+// 3 bytes: tones, noise, silence and full-scale steps in turns, the seed changes the signal
+std::vector<uint8_t> testSignal(uint32_t bits, uint32_t numChannels, uint32_t numFrames, uint32_t seed);
+
+// A WAV file with the PCM, WAVE_FORMAT_EXTENSIBLE for more than 2 channels
+std::vector<uint8_t> wavFile(uint32_t sampleRate, uint32_t bits, uint32_t numChannels, const std::vector<uint8_t> &pcm);
+
+// The decoded PCM of an m4a file, by numThreads threads; the ALAC depth in bitDepth
+std::vector<uint8_t> decodeM4a(const std::string &path, uint32_t numThreads = 1, uint32_t *bitDepth = nullptr);
+
+// The big-endian integers
+uint32_t readBE16(const uint8_t *p);
+uint32_t readBE32(const uint8_t *p);
+uint64_t readBE64(const uint8_t *p);
+
+// An MP4 atom: its type, the position of the atom and of its data in the file and its size
+struct Box
+{
+    std::string type;
+    uint64_t    pos     = 0;
+    uint64_t    dataPos = 0;
+    uint64_t    size    = 0;
+};
+
+// The atoms from begin up to end, the 64-bit sizes included; an empty list if the sizes don't fit
+std::vector<Box> childBoxes(const std::vector<uint8_t> &file, uint64_t begin, uint64_t end);
+
+// The first child atom of the type, a box of size 0 if there is none
+Box findBox(const std::vector<uint8_t> &file, const Box &parent, const std::string &type);
+
+// The ALAC packets decoded with the magic cookie, the packets are one buffer in packetSizes
+// parts with their frame counts in packetFrames; an empty buffer if a packet can't be decoded
+std::vector<uint8_t> decodePackets(const std::vector<uint8_t> &cookie, const uint8_t *data, const std::vector<uint32_t> &packetSizes, const std::vector<uint32_t> &packetFrames);
+
+#endif // TESTUTILS_H
@@ -74,6 +74,13 @@ Bytes &operator<<(Bytes &out, uint32_t value)
     return out;
 }
 
+Bytes &operator<<(Bytes &out, uint64_t value)
+{
+    out << uint32_t(value >> 32);
+    out << uint32_t(value >> 0);
+    return out;
+}
+
 Bytes &operator<<(Bytes &out, const char val[4])
 {
     out.push_back(val[0]);
@@ -190,6 +197,12 @@ OutFile &OutFile::operator<<(const char value[5])
     return *this;
 }
 
+void OutFile::seekp(uint64_t pos)
+{
+    mStream.seekp(pos);
+    mPos = pos;
+}
+
 void OutFile::write(const unsigned char *data, std::streamsize size)
 {
     mStream.write((char *)(data), size);
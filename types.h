@@ -67,6 +67,7 @@ using Bytes = std::vector<char>;
 Bytes &operator<<(Bytes &out, char value);
 Bytes &operator<<(Bytes &out, uint16_t value);
 Bytes &operator<<(Bytes &out, uint32_t value);
+Bytes &operator<<(Bytes &out, uint64_t value);
 Bytes &operator<<(Bytes &out, const char val[4]);
 Bytes &operator<<(Bytes &out, const Bytes &value);
 Bytes &operator<<(Bytes &out, const std::string &value);
@@ -78,7 +79,8 @@ public:
     explicit OutFile(const std::string &fileName);
     // virtual ~OutFile();
 
-    uint32_t tellp() const { return mPos; }
+    uint64_t tellp() const { return mPos; }
+    void     seekp(uint64_t pos);
     bool     good() const { return mStream.good(); }
     void     flush();
 
@@ -95,7 +97,7 @@ public:
 private:
     std::ofstream mFile;
     std::ostream &mStream;
-    uint32_t      mPos = 0;
+    uint64_t      mPos = 0;
 };
 
 bool iequals(const std::string &a, const std::string &b);
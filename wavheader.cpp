@@ -42,6 +42,16 @@ static const char *WAV_WAVE = "WAVE";
 static const char *WAV_FMT  = "fmt ";
 static const char *WAV_DATA = "data";
 
+static const char *RF64_RIFF = "RF64";
+static const char *BW64_RIFF = "BW64";
+static const char *RF64_DS64 = "ds64";
+
+// the 32-bit size fields that are set in the ds64 chunk
+static constexpr uint32_t RF64_SIZE_IN_DS64 = 0xFFFFFFFF;
+
+// the chunks that may be mapped to tags are kept up to this size, all the other ones are skipped
+static constexpr uint64_t MAX_KEPT_CHUNK_SIZE = 1024 * 1024;
+
 static const char                   *WAVE64_RIFF      = "riff";
 static const char                   *WAVE64_WAVE      = "wave";
 static const std::array<uint8_t, 16> WAVE64_GUID_RIFF = { 0x72, 0x69, 0x66, 0x66, 0x2E, 0x91, 0xCF, 0x11, 0xA5, 0xD6, 0x28, 0xDB, 0x04, 0xC1, 0x00, 0x00 };
@@ -249,6 +259,14 @@ static ByteArray readBytes(std::istream *stream, size_t size)
     return res;
 }
 
+/************************************************
+ * LIST holds the INFO tags, id3 and ID3 an ID3v2 tag
+ ************************************************/
+static bool isTagChunk(const char id[4])
+{
+    return strncmp(id, "LIST", 4) == 0 || strncmp(id, "list", 4) == 0 || strncmp(id, "id3 ", 4) == 0 || strncmp(id, "ID3 ", 4) == 0;
+}
+
 /************************************************
  *
  ************************************************/
@@ -326,6 +344,26 @@ ByteArray &operator<<(ByteArray &out, const Guid &val)
     return out;
 }
 
+/************************************************
+ * Seeks past the bytes, or reads them when the stream
+ * can't seek, e.g. the standard input from a pipe
+ ************************************************/
+void WavHeader::skip(std::istream *stream, uint64_t size)
+{
+    if (size == 0) {
+        return;
+    }
+
+    if (stream->tellg() != std::streampos(-1) && stream->seekg(size, std::ios::cur)) {
+        return;
+    }
+
+    stream->clear();
+    if (uint64_t(stream->ignore(size).gcount()) != size) {
+        throw WavHeaderError("Unexpected end of file");
+    }
+}
+
 /************************************************
  * See WAV specoification
  *   http://www-mmsp.ece.mcgill.ca/Documents/AudioFormats/WAVE/WAVE.html
@@ -337,7 +375,7 @@ WavHeader::WavHeader(std::istream *stream) noexcept(false)
 
     mustRead(stream, tag, 4);
 
-    if (strcmp(tag, WAV_RIFF) == 0) {
+    if (strcmp(tag, WAV_RIFF) == 0 || strcmp(tag, RF64_RIFF) == 0 || strcmp(tag, BW64_RIFF) == 0) {
         m64Bit = false;
         readWavHeader(stream);
 
@@ -354,6 +392,22 @@ WavHeader::WavHeader(std::istream *stream) noexcept(false)
     throw WavHeaderError("WAVE header is missing RIFF tag while processing file");
 }
 
+/************************************************
+ *
+ ************************************************/
+WavHeader::WavHeader(uint32_t sampleRate, uint16_t bitsPerSample, uint16_t numChannels, bool bigEndian)
+{
+    mFormat        = Format_PCM;
+    mNumChannels   = numChannels;
+    mSampleRate    = sampleRate;
+    mBitsPerSample = bitsPerSample;
+    mBlockAlign    = (bitsPerSample + 7) / 8 * numChannels;
+    mByteRate      = mBlockAlign * sampleRate;
+    mDataSizeKnown = false;
+    mDataStartPos  = 0;
+    mBigEndian     = bigEndian;
+}
+
 /************************************************
  * 52 49 46 46      RIFF
  * 24 B9 4D 02      file size - 8
@@ -374,7 +428,9 @@ WavHeader::WavHeader(std::istream *stream) noexcept(false)
  ************************************************/
 void WavHeader::readWavHeader(std::istream *stream)
 {
-    this->mFileSize = readUInt32(stream) + 8;
+    // a program writing to a pipe can't go back to set the sizes, it leaves them 0 or 0xFFFFFFFF
+    uint32_t riffSize = readUInt32(stream);
+    this->mFileSize   = (riffSize == 0 || riffSize == 0xFFFFFFFF) ? UINT64_MAX : uint64_t(riffSize) + 8;
 
     FourCC waveTag;
     waveTag.load(stream);
@@ -384,7 +440,9 @@ void WavHeader::readWavHeader(std::istream *stream)
     }
 
     FourCC   chunkId;
-    uint64_t pos = 12;
+    uint64_t pos          = 12;
+    bool     hasDs64      = false;
+    uint64_t ds64DataSize = 0;
     while (pos < this->mFileSize) {
 
         chunkId.load(stream);
@@ -392,7 +450,14 @@ void WavHeader::readWavHeader(std::istream *stream)
         pos += 8;
 
         if (chunkId == WAV_DATA) {
-            this->mDataSize     = chunkSize;
+            if (hasDs64 && chunkSize == RF64_SIZE_IN_DS64) {
+                this->mDataSize = ds64DataSize;
+            }
+            else {
+                // 0 is a size as well, only the caller knows if the input is a pipe
+                this->mDataSize      = (chunkSize == 0xFFFFFFFF) ? 0 : chunkSize;
+                this->mDataSizeKnown = chunkSize != 0xFFFFFFFF;
+            }
             this->mDataStartPos = pos;
             return;
         }
@@ -401,16 +466,37 @@ void WavHeader::readWavHeader(std::istream *stream)
             throw WavHeaderError("[WAV] incorrect chunk size " + std::to_string(chunkSize) + " at " + std::to_string(pos - 4));
         }
 
-        if (chunkId == WAV_FMT) {
+        // RF64 and BW64 files have the 64-bit sizes of the RIFF and data chunks in the ds64 chunk,
+        // followed by the sample count and a table of the other large chunks, which are not used
+        if (chunkId == RF64_DS64) {
+            if (chunkSize < 28) {
+                throw WavHeaderError("[RF64] incorrect ds64 chunk size " + std::to_string(chunkSize));
+            }
+
+            uint64_t riffSize64 = readUInt64(stream);
+            ds64DataSize        = readUInt64(stream);
+            skip(stream, chunkSize - 16);
+            hasDs64 = true;
+
+            if (riffSize == RF64_SIZE_IN_DS64 && riffSize64 > 0) {
+                this->mFileSize = riffSize64 + 8;
+            }
+        }
+        else if (chunkId == WAV_FMT) {
             loadFmtChunk(stream, chunkSize);
-            pos += chunkSize;
         }
-        else {
+        else if (isTagChunk(chunkId.data()) && chunkSize <= MAX_KEPT_CHUNK_SIZE) {
             mOtherCunks << chunkId;
             mOtherCunks << chunkSize;
             mOtherCunks << readBytes(stream, chunkSize);
-            pos += chunkSize;
         }
+        else {
+            skip(stream, chunkSize);
+        }
+
+        // the chunks are word-aligned, the pad byte isn't counted in the size
+        skip(stream, chunkSize & 1);
+        pos += chunkSize + (chunkSize & 1);
     }
 
     throw WavHeaderError("data chunk not found");
@@ -457,14 +543,16 @@ void WavHeader::readWave64Header(std::istream *stream)
 
         if (chunkId.startsWidth(WAV_FMT)) {
             loadFmtChunk(stream, chunkSize - 16 - 8);
-            pos += chunkSize - WAVE64_CHUNK_HEADER_SIZE;
         }
-        else {
+        else if (isTagChunk(chunkId.data()) && chunkSize - WAVE64_CHUNK_HEADER_SIZE <= MAX_KEPT_CHUNK_SIZE) {
             mOtherCunks << chunkId;
             mOtherCunks << chunkSize;
             mOtherCunks << readBytes(stream, chunkSize - WAVE64_CHUNK_HEADER_SIZE);
-            pos += chunkSize - WAVE64_CHUNK_HEADER_SIZE;
         }
+        else {
+            skip(stream, chunkSize - WAVE64_CHUNK_HEADER_SIZE);
+        }
+        pos += chunkSize - WAVE64_CHUNK_HEADER_SIZE;
     }
 
     throw WavHeaderError("data chunk not found");
@@ -483,6 +571,26 @@ bool WavHeader::isCdQuality() const
     return mNumChannels == CD_NUM_CHANNELS && mBitsPerSample == CD_BITS_PER_SAMPLE && mSampleRate == CD_SAMPLE_RATE && mByteRate == CD_BYTE_RATE;
 }
 
+/************************************************
+ * The extensible format has the format code in
+ * the first two bytes of the subformat GUID
+ ************************************************/
+WavHeader::Format WavHeader::sampleFormat() const
+{
+    if (mFormat == Format_Extensible && mSubFormat.size() >= 2) {
+        return Format(mSubFormat[0] | (mSubFormat[1] << 8));
+    }
+    return mFormat;
+}
+
+/************************************************
+ *
+ ************************************************/
+bool WavHeader::isFloat() const
+{
+    return sampleFormat() == Format_IEEE_FLOAT;
+}
+
 /************************************************
  *
  ************************************************/
@@ -717,8 +825,18 @@ ByteArray WavHeader::wave64ToByteArray() const
 /************************************************
  *
  ************************************************/
-void WavHeader::resizeData(uint32_t dataSize)
+void WavHeader::resizeData(uint64_t dataSize)
 {
-    mDataSize = dataSize;
+    mDataSize      = dataSize;
+    mDataSizeKnown = true;
     mFileSize = mDataStartPos + mDataSize;
 }
+
+/************************************************
+ *
+ ************************************************/
+void WavHeader::setDataSizeUnknown()
+{
+    mDataSize      = 0;
+    mDataSizeKnown = false;
+}
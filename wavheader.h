@@ -84,6 +84,10 @@ public:
     WavHeader() = default;
     explicit WavHeader(std::istream *stream) noexcept(false);
 
+    /// Describes headerless PCM that lasts until the end of the input,
+    /// the samples are (bitsPerSample + 7) / 8 bytes long and left-justified.
+    WavHeader(uint32_t sampleRate, uint16_t bitsPerSample, uint16_t numChannels, bool bigEndian = false);
+
     WavHeader(const WavHeader &other) = default;
     WavHeader &operator=(const WavHeader &other) = default;
 
@@ -93,13 +97,15 @@ public:
     // QByteArray toByteArray() const;
     // QByteArray toLegacyWav() const;
 
-    void resizeData(uint32_t dataSize);
+    void resizeData(uint64_t dataSize);
+    void setDataSizeUnknown();
 
     static uint32_t bytesPerSecond(Quality quality);
     uint32_t        bytesPerSecond();
 
     uint64_t fileSize() const { return mFileSize; }
     Format   format() const { return mFormat; }
+    Format   sampleFormat() const;
     uint16_t numChannels() const { return mNumChannels; }
     uint32_t sampleRate() const { return mSampleRate; }
     uint32_t byteRate() const { return mByteRate; }
@@ -108,6 +114,9 @@ public:
     uint16_t validBitsPerSample() const { return mValidBitsPerSample; }
     uint32_t channelMask() const { return mChannelMask; }
     uint64_t dataSize() const { return mDataSize; }
+    bool     isDataSizeKnown() const { return mDataSizeKnown; }
+    bool     isBigEndian() const { return mBigEndian; }
+    bool     isFloat() const;
     uint64_t dataStartPos() const { return mDataStartPos; }
     bool     isCdQuality() const;
     bool     is64Bit() const { return m64Bit; }
@@ -133,10 +142,14 @@ protected:
     uint32_t     mChannelMask        = 0;     // Speaker position mask
     ByteArray    mSubFormat          = { 0 }; // GUID (first two bytes are the data format code)
     uint64_t     mDataSize           = 0;
+    bool         mDataSizeKnown      = true;  // false if the data lasts until the end of the input
+    bool         mBigEndian          = false; // the byte order of the samples
     uint64_t     mDataStartPos       = 0;
 
     ByteArray mOtherCunks;
 
+    static void skip(std::istream *stream, uint64_t size);
+
 private:
     void loadFmtChunk(std::istream *stream, const uint32_t chunkSize);
 